@@ -40,12 +40,41 @@
 
 #include "qmirclientbackingstore.h"
 #include "qmirclientlogging.h"
+#include "qmirclientwindow.h"
 #include <QtGui/QOffscreenSurface>
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QOpenGLTexture>
 #include <QtGui/QMatrix4x4>
 #include <QtGui/private/qopengltextureblitter_p.h>
 #include <QtGui/qopenglfunctions.h>
+#include <QtMath>
+
+namespace {
+
+// Mir streams are triple buffered, older buffers are unlikely
+const int MaxBufferAge = 4;
+
+// Window coordinates to buffer pixels, with the origin at the bottom left as glScissor wants
+QRect scissorRect(const QRect &rect, qreal scale, int bufferHeight)
+{
+    const int left = qFloor(rect.left() * scale);
+    const int top = qFloor(rect.top() * scale);
+    const int right = qCeil((rect.right() + 1) * scale);
+    const int bottom = qCeil((rect.bottom() + 1) * scale);
+    return QRect(left, bufferHeight - bottom, right - left, bottom - top);
+}
+
+// In window pixels, the rectangles of a QRegion don't overlap
+qint64 regionArea(const QRegion &region)
+{
+    qint64 area = 0;
+    for (const QRect &rect : region.rects()) {
+        area += qint64(rect.width()) * rect.height();
+    }
+    return area;
+}
+
+} // anonymous namespace
 
 QMirClientBackingStore::QMirClientBackingStore(QWindow* window)
     : QPlatformBackingStore(window)
@@ -81,23 +110,70 @@ QMirClientBackingStore::~QMirClientBackingStore()
 
 void QMirClientBackingStore::flush(QWindow* window, const QRegion& region, const QPoint& offset)
 {
-    Q_UNUSED(region);
     Q_UNUSED(offset);
     mContext->makeCurrent(window);
-    glViewport(0, 0, window->width(), window->height());
+    auto platformWindow = static_cast<QMirClientWindow*>(window->handle());
+
+    // Windows with a render scale have smaller buffers, the image is scaled down into them
+    const qreal renderScale = platformWindow->renderScale();
+    const int bufferHeight = qRound(window->height() * renderScale);
+    glViewport(0, 0, qRound(window->width() * renderScale), bufferHeight);
 
     updateTexture();
 
     if (!mBlitter->isCreated())
         mBlitter->create();
 
+    // Only what changed since the buffer we got was last used needs blitting again
+    const int bufferAge = platformWindow->bufferAge();
+    const QRect windowRect(QPoint(), window->size());
+    const QRegion repaint = repaintRegion(bufferAge, region) & windowRect;
+    const bool partial = repaint != QRegion(windowRect);
+    qCDebug(mirclientBufferSwap, "flush(window=%p) - buffer age %d, blitting %lld of %lld pixels",
+            window, bufferAge, regionArea(repaint), qint64(windowRect.width()) * windowRect.height());
+
     mBlitter->bind();
-    mBlitter->blit(mTexture->textureId(), QMatrix4x4(), QOpenGLTextureBlitter::OriginTopLeft);
+    if (partial) {
+        glEnable(GL_SCISSOR_TEST);
+        for (const QRect &rect : repaint.rects()) {
+            const QRect scissor = scissorRect(rect, renderScale, bufferHeight);
+            glScissor(scissor.x(), scissor.y(), scissor.width(), scissor.height());
+            mBlitter->blit(mTexture->textureId(), QMatrix4x4(), QOpenGLTextureBlitter::OriginTopLeft);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    } else {
+        mBlitter->blit(mTexture->textureId(), QMatrix4x4(), QOpenGLTextureBlitter::OriginTopLeft);
+    }
     mBlitter->release();
 
+    // Only the flushed region changed since the last frame, whatever else got blitted
+    platformWindow->addSwapDamage(region);
     mContext->swapBuffers(window);
 }
 
+/*
+    A buffer of age N holds the frame from N swaps ago, so it lacks the damage of the N - 1 frames
+    since on top of the current one. Age 0 means its contents are undefined (no EGL_EXT_buffer_age,
+    or a new buffer), as do ages beyond the history we kept.
+ */
+QRegion QMirClientBackingStore::repaintRegion(int bufferAge, const QRegion &damage)
+{
+    QRegion repaint = damage;
+    if (bufferAge <= 0 || bufferAge > mDamageHistory.size() + 1) {
+        repaint = QRect(QPoint(), window()->size());
+    } else {
+        for (int i = 0; i < bufferAge - 1; ++i) {
+            repaint |= mDamageHistory.at(i);
+        }
+    }
+
+    mDamageHistory.prepend(damage);
+    if (mDamageHistory.size() > MaxBufferAge) {
+        mDamageHistory.removeLast();
+    }
+    return repaint;
+}
+
 void QMirClientBackingStore::updateTexture()
 {
     if (mDirty.isNull())
@@ -153,6 +229,7 @@ void QMirClientBackingStore::beginPaint(const QRegion& region)
 void QMirClientBackingStore::resize(const QSize& size, const QRegion& /*staticContents*/)
 {
     mImage = QImage(size, QImage::Format_RGBA8888);
+    mDamageHistory.clear();
 
     mContext->makeCurrent(window());
 
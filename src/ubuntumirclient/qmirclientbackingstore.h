@@ -42,6 +42,7 @@
 #define QMIRCLIENTBACKINGSTORE_H
 
 #include <qpa/qplatformbackingstore.h>
+#include <QList>
 
 class QOpenGLContext;
 class QOpenGLTexture;
@@ -62,6 +63,7 @@ public:
 
 protected:
     void updateTexture();
+    QRegion repaintRegion(int bufferAge, const QRegion &damage);
 
 private:
     QScopedPointer<QOpenGLContext> mContext;
@@ -69,6 +71,9 @@ private:
     QScopedPointer<QOpenGLTextureBlitter> mBlitter;
     QImage mImage;
     QRegion mDirty;
+
+    // Regions flushed in the last few frames, most recent first
+    QList<QRegion> mDamageHistory;
 };
 
 #endif // QMIRCLIENTBACKINGSTORE_H
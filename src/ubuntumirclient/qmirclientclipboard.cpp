@@ -45,6 +45,7 @@
 #include <QDBusPendingCallWatcher>
 #include <QGuiApplication>
 #include <QSignalBlocker>
+#include <qpa/qplatformnativeinterface.h>
 #include <QtCore/QMimeData>
 #include <QtCore/QStringList>
 
@@ -54,6 +55,16 @@
 // get this cumbersome nested namespace out of the way
 using namespace com::ubuntu::content;
 
+namespace {
+
+// Empty until Mir has answered the request made when the window was created
+QString persistentSurfaceId(QWindow *window)
+{
+    return static_cast<QMirClientWindow*>(window->handle())->persistentSurfaceId();
+}
+
+} // anonymous namespace
+
 QMirClientClipboard::QMirClientClipboard()
     : mMimeData(new QMimeData)
     , mContentHub(Hub::Client::instance())
@@ -68,6 +79,9 @@ QMirClientClipboard::QMirClientClipboard()
     connect(qGuiApp, &QGuiApplication::applicationStateChanged,
         this, &QMirClientClipboard::onApplicationStateChanged);
 
+    connect(qGuiApp->platformNativeInterface(), &QPlatformNativeInterface::windowPropertyChanged,
+        this, &QMirClientClipboard::onWindowPropertyChanged);
+
     requestMimeData();
 }
 
@@ -98,17 +112,15 @@ void QMirClientClipboard::setMimeData(QMimeData* mimeData, QClipboard::Mode mode
 {
     QWindow *focusWindow = QGuiApplication::focusWindow();
     if (focusWindow && mode == QClipboard::Clipboard && mimeData != nullptr) {
-        QString surfaceId = static_cast<QMirClientWindow*>(focusWindow->handle())->persistentSurfaceId();
-
-        QDBusPendingCall reply = mContentHub->createPaste(surfaceId, *mimeData);
-
-        // Don't care whether it succeeded
-        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-        connect(watcher, &QDBusPendingCallWatcher::finished,
-                watcher, &QObject::deleteLater);
-
         mMimeData = mimeData;
         mClipboardState = SyncedClipboard;
+
+        const QString surfaceId = persistentSurfaceId(focusWindow);
+        if (surfaceId.isEmpty()) {
+            deferUntilSurfaceId(focusWindow, CreatePaste);
+        } else {
+            createPaste(surfaceId);
+        }
         emitChanged(QClipboard::Clipboard);
     }
 }
@@ -143,8 +155,15 @@ void QMirClientClipboard::updateMimeData()
 
     QWindow *focusWindow = QGuiApplication::focusWindow();
     if (focusWindow) {
+        // Rather than wait for Mir, keep returning what we have until the paste arrives
+        const QString surfaceId = persistentSurfaceId(focusWindow);
+        if (surfaceId.isEmpty()) {
+            deferUntilSurfaceId(focusWindow, RequestPaste);
+            return;
+        }
+
         delete mMimeData;
-        QString surfaceId = static_cast<QMirClientWindow*>(focusWindow->handle())->persistentSurfaceId();
+        mDeferredWork &= ~CreatePaste;
         mMimeData = mContentHub->latestPaste(surfaceId);
         mClipboardState = SyncedClipboard;
         emitChanged(QClipboard::Clipboard);
@@ -163,7 +182,12 @@ void QMirClientClipboard::requestMimeData()
         return;
     }
 
-    QString surfaceId = static_cast<QMirClientWindow*>(focusWindow->handle())->persistentSurfaceId();
+    const QString surfaceId = persistentSurfaceId(focusWindow);
+    if (surfaceId.isEmpty()) {
+        deferUntilSurfaceId(focusWindow, RequestPaste);
+        return;
+    }
+
     QDBusPendingCall reply = mContentHub->requestLatestPaste(surfaceId);
     mClipboardState = SyncingClipboard;
 
@@ -171,6 +195,7 @@ void QMirClientClipboard::requestMimeData()
     connect(mPasteReply, &QDBusPendingCallWatcher::finished,
             this, [this]() {
         delete mMimeData;
+        mDeferredWork &= ~CreatePaste;
         mMimeData = mContentHub->paste(*mPasteReply);
         mClipboardState = SyncedClipboard;
         mPasteReply->deleteLater();
@@ -178,3 +203,46 @@ void QMirClientClipboard::requestMimeData()
         emitChanged(QClipboard::Clipboard);
     });
 }
+
+void QMirClientClipboard::createPaste(const QString &surfaceId)
+{
+    QDBusPendingCall reply = mContentHub->createPaste(surfaceId, *mMimeData);
+
+    // Don't care whether it succeeded
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            watcher, &QObject::deleteLater);
+}
+
+// The work is for the clipboard, not for a window: any window's surface id will do, so work
+// deferred for a window that lost focus moves on to the new focus window
+void QMirClientClipboard::deferUntilSurfaceId(QWindow *window, DeferredWork work)
+{
+    mDeferredWindow = window;
+    mDeferredWork |= work;
+}
+
+void QMirClientClipboard::onWindowPropertyChanged(QPlatformWindow *window, const QString &property)
+{
+    if (!mDeferredWindow || window != mDeferredWindow->handle() || property != QLatin1String("persistentSurfaceId")) {
+        return;
+    }
+
+    const QString surfaceId = persistentSurfaceId(mDeferredWindow);
+    const int work = mDeferredWork;
+    mDeferredWindow = nullptr;
+    mDeferredWork = 0;
+
+    if (surfaceId.isEmpty()) {
+        qCWarning(mirclient, "No persistent surface id for window %p, content-hub is not told of the clipboard",
+                  window->window());
+        return;
+    }
+
+    if (work & CreatePaste) {
+        createPaste(surfaceId);
+    }
+    if ((work & RequestPaste) && mClipboardState == OutdatedClipboard) {
+        requestMimeData();
+    }
+}
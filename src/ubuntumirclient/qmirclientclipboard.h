@@ -55,6 +55,8 @@ namespace com {
 }
 
 class QDBusPendingCallWatcher;
+class QPlatformWindow;
+class QWindow;
 
 class QMirClientClipboard : public QObject, public QPlatformClipboard
 {
@@ -71,10 +73,19 @@ public:
 
 private Q_SLOTS:
     void onApplicationStateChanged(Qt::ApplicationState state);
+    void onWindowPropertyChanged(QPlatformWindow *window, const QString &property);
 
 private:
+    // What waits for the focus window's persistent surface id, which content-hub needs
+    enum DeferredWork {
+        CreatePaste = 0x1, // publish mMimeData
+        RequestPaste = 0x2 // fetch the latest paste
+    };
+
     void updateMimeData();
     void requestMimeData();
+    void createPaste(const QString &surfaceId);
+    void deferUntilSurfaceId(QWindow *window, DeferredWork work);
 
     QMimeData *mMimeData;
 
@@ -87,6 +98,9 @@ private:
     com::ubuntu::content::Hub *mContentHub;
 
     QDBusPendingCallWatcher *mPasteReply{nullptr};
+
+    QPointer<QWindow> mDeferredWindow;
+    int mDeferredWork{0};
 };
 
 #endif // QMIRCLIENTCLIPBOARD_H
@@ -0,0 +1,256 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#include "qmirclienteglconfigcache.h"
+#include "qmirclientlogging.h"
+
+#include <QMutexLocker>
+#include <QtPlatformSupport/private/qeglconvenience_p.h>
+
+#include <mir_toolkit/mir_client_library.h>
+
+#include <algorithm>
+
+/*
+ * QMirClientEglConfigCache - remembers the EGLConfig, resulting surface format and Mir pixel format
+ * chosen for a requested QSurfaceFormat.
+ *
+ * Choosing a config means enumerating the EGL configs (twice on Mesa when falling back to OpenGL 1.4)
+ * and asking Mir for the matching pixel format. Windows and contexts are mostly created with the
+ * same few formats, so this only needs doing once per format.
+ *
+ * Formats asking for at most 5/6/5 bits of red/green/blue and no alpha get an RGB565 config, as do
+ * formats not asking for any color depth when QTUBUNTU_RGB565_SURFACES is set. Halving the bytes per
+ * pixel matters on devices short of memory bandwidth, at the cost of banding in gradients. The usual
+ * 32-bit config is used when EGL has no such config or the compositor doesn't accept the format.
+ */
+
+namespace {
+
+MirPixelFormat disableAlphaBufferIfPossible(MirPixelFormat pixelFormat)
+{
+    switch (pixelFormat) {
+    case mir_pixel_format_abgr_8888:
+        return mir_pixel_format_xbgr_8888;
+    case mir_pixel_format_argb_8888:
+        return mir_pixel_format_xrgb_8888;
+    default: // can do nothing, leave it alone
+        return pixelFormat;
+    }
+}
+
+bool rgb565ByDefault()
+{
+    static const bool rgb565 = qEnvironmentVariableIsSet("QTUBUNTU_RGB565_SURFACES");
+    return rgb565;
+}
+
+bool wantsRgb565(const QSurfaceFormat &format)
+{
+    if (format.alphaBufferSize() > 0) {
+        return false;
+    }
+
+    const int red = format.redBufferSize();
+    const int green = format.greenBufferSize();
+    const int blue = format.blueBufferSize();
+    if (red < 0 && green < 0 && blue < 0) {
+        return rgb565ByDefault();
+    }
+    return red > 0 && red <= 5 && green > 0 && green <= 6 && blue > 0 && blue <= 5;
+}
+
+bool compositorSupports(MirConnection *connection, MirPixelFormat pixelFormat)
+{
+    MirPixelFormat formats[mir_pixel_formats];
+    unsigned int formatCount = 0;
+    mir_connection_get_available_surface_formats(connection, formats, mir_pixel_formats, &formatCount);
+    return std::find(formats, formats + formatCount, pixelFormat) != formats + formatCount;
+}
+
+} // anonymous namespace
+
+QMirClientEglConfigCache::Key::Key(const QSurfaceFormat &format)
+    : red(format.redBufferSize())
+    , green(format.greenBufferSize())
+    , blue(format.blueBufferSize())
+    , alpha(format.alphaBufferSize())
+    , depth(format.depthBufferSize())
+    , stencil(format.stencilBufferSize())
+    , samples(format.samples())
+    , renderableType(format.renderableType())
+    , profile(format.profile())
+    , majorVersion(format.majorVersion())
+    , minorVersion(format.minorVersion())
+    , options(format.options())
+    , swapBehavior(format.swapBehavior())
+    , swapInterval(format.swapInterval())
+{
+}
+
+bool QMirClientEglConfigCache::Key::operator==(const Key &o) const
+{
+    return red == o.red && green == o.green && blue == o.blue && alpha == o.alpha
+            && depth == o.depth && stencil == o.stencil && samples == o.samples
+            && renderableType == o.renderableType && profile == o.profile
+            && majorVersion == o.majorVersion && minorVersion == o.minorVersion
+            && options == o.options && swapBehavior == o.swapBehavior && swapInterval == o.swapInterval;
+}
+
+uint qHash(const QMirClientEglConfigCache::Key &key, uint seed)
+{
+    uint h = seed;
+    for (int value : { key.red, key.green, key.blue, key.alpha, key.depth, key.stencil, key.samples,
+                       key.renderableType, key.profile, key.majorVersion, key.minorVersion,
+                       key.options, key.swapBehavior, key.swapInterval }) {
+        h = 31 * h + uint(value);
+    }
+    return h;
+}
+
+QMirClientEglConfigCache::QMirClientEglConfigCache(EGLDisplay display, MirConnection *connection)
+    : mEglDisplay(display)
+    , mMirConnection(connection)
+{
+}
+
+QMirClientSurfaceConfig QMirClientEglConfigCache::configForFormat(const QSurfaceFormat &requestedFormat)
+{
+    const Key key(requestedFormat);
+
+    QMutexLocker lock(&mMutex);
+    auto it = mConfigs.constFind(key);
+    if (it != mConfigs.constEnd()) {
+        ++mHits;
+        qCDebug(mirclientGraphics, "EGL config cache hit (hits=%u, misses=%u)", mHits, mMisses);
+        return it.value();
+    }
+
+    ++mMisses;
+    qCDebug(mirclientGraphics, "EGL config cache miss (hits=%u, misses=%u)", mHits, mMisses);
+
+    const auto config = chooseConfig(requestedFormat);
+    mConfigs.insert(key, config);
+    return config;
+}
+
+QMirClientSurfaceConfig QMirClientEglConfigCache::chooseConfig(const QSurfaceFormat &requestedFormat) const
+{
+    if (wantsRgb565(requestedFormat)) {
+        const auto result = chooseRgb565Config(requestedFormat);
+        if (result.config) {
+            return result;
+        }
+    }
+
+    QMirClientSurfaceConfig result;
+    QSurfaceFormat format = requestedFormat;
+
+    // Have Qt choose most suitable EGLConfig for the requested surface format, and update format to reflect it
+    result.config = q_configFromGLFormat(mEglDisplay, format, true);
+    if (result.config == 0) {
+        // Older Intel Atom-based devices only support OpenGL 1.4 compatibility profile but by default
+        // QML asks for at least OpenGL 2.0. The XCB GLX backend ignores this request and returns a
+        // 1.4 context, but the XCB EGL backend tries to honor it, and fails. The 1.4 context appears to
+        // have sufficient capabilities on MESA (i915) to render correctly however. So reduce the default
+        // requested OpenGL version to 1.0 to ensure EGL will give us a working context (lp:1549455).
+        static const bool isMesa = QString(eglQueryString(mEglDisplay, EGL_VENDOR)).contains(QStringLiteral("Mesa"));
+        if (isMesa) {
+            qCDebug(mirclientGraphics, "Attempting to choose OpenGL 1.4 context which may suit Mesa");
+            format.setMajorVersion(1);
+            format.setMinorVersion(4);
+            result.config = q_configFromGLFormat(mEglDisplay, format, true);
+        }
+    }
+    if (result.config == 0) {
+        qCritical() << "Qt failed to choose a suitable EGLConfig to suit the surface format" << format;
+    }
+
+    result.format = q_glFormatFromConfig(mEglDisplay, result.config, format);
+
+    // Have Mir decide the pixel format most suited to the chosen EGLConfig. This is the only way
+    // Mir will know what EGLConfig has been chosen - it cannot deduce it from the buffers.
+    result.pixelFormat = mir_connection_get_egl_pixel_format(mMirConnection, mEglDisplay, result.config);
+    // But the chosen EGLConfig might have an alpha buffer enabled, even if not requested by the client.
+    // If that's the case, try to edit the chosen pixel format in order to disable the alpha buffer.
+    // This is an optimization for the compositor, as it can avoid blending this surface.
+    if (requestedFormat.alphaBufferSize() < 0) {
+        result.pixelFormat = disableAlphaBufferIfPossible(result.pixelFormat);
+    }
+
+    return result;
+}
+
+QMirClientSurfaceConfig QMirClientEglConfigCache::chooseRgb565Config(const QSurfaceFormat &requestedFormat) const
+{
+    QMirClientSurfaceConfig result;
+    QSurfaceFormat format = requestedFormat;
+    format.setRedBufferSize(5);
+    format.setGreenBufferSize(6);
+    format.setBlueBufferSize(5);
+    format.setAlphaBufferSize(0);
+
+    // Not asking for the highest pixel format makes Qt pick a config of exactly the requested depth
+    // if there is one, it falls back to the first (deepest) config otherwise
+    const EGLConfig config = q_configFromGLFormat(mEglDisplay, format, false);
+    if (config == 0) {
+        qCDebug(mirclientGraphics, "No EGLConfig for an RGB565 surface, falling back to 32-bit");
+        return result;
+    }
+
+    format = q_glFormatFromConfig(mEglDisplay, config, format);
+    if (format.redBufferSize() != 5 || format.greenBufferSize() != 6 || format.blueBufferSize() != 5) {
+        qCDebug(mirclientGraphics, "No RGB565 EGLConfig, falling back to 32-bit");
+        return result;
+    }
+
+    const auto pixelFormat = mir_connection_get_egl_pixel_format(mMirConnection, mEglDisplay, config);
+    if (pixelFormat != mir_pixel_format_rgb_565 || !compositorSupports(mMirConnection, pixelFormat)) {
+        qCDebug(mirclientGraphics, "Mir doesn't accept RGB565 surfaces, falling back to 32-bit");
+        return result;
+    }
+
+    qCDebug(mirclientGraphics, "Chose an RGB565 EGLConfig");
+    result.config = config;
+    result.format = format;
+    result.pixelFormat = pixelFormat;
+    return result;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QMIRCLIENTEGLCONFIGCACHE_H
+#define QMIRCLIENTEGLCONFIGCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSurfaceFormat>
+
+#include <mir_toolkit/common.h>
+
+#include <EGL/egl.h>
+
+struct MirConnection;
+
+struct QMirClientSurfaceConfig
+{
+    EGLConfig config{nullptr};
+    QSurfaceFormat format;  // requested format updated to reflect the chosen EGLConfig
+    MirPixelFormat pixelFormat{mir_pixel_format_invalid};
+};
+
+class QMirClientEglConfigCache
+{
+public:
+    QMirClientEglConfigCache(EGLDisplay display, MirConnection *connection);
+
+    // Thread-safe, as OpenGL contexts may be created on the render thread
+    QMirClientSurfaceConfig configForFormat(const QSurfaceFormat &requestedFormat);
+
+private:
+    struct Key
+    {
+        explicit Key(const QSurfaceFormat &format);
+        bool operator==(const Key &other) const;
+
+        int red, green, blue, alpha, depth, stencil, samples;
+        int renderableType, profile, majorVersion, minorVersion;
+        int options, swapBehavior, swapInterval;
+    };
+    friend uint qHash(const Key &key, uint seed);
+
+    QMirClientSurfaceConfig chooseConfig(const QSurfaceFormat &requestedFormat) const;
+    QMirClientSurfaceConfig chooseRgb565Config(const QSurfaceFormat &requestedFormat) const;
+
+    const EGLDisplay mEglDisplay;
+    MirConnection * const mMirConnection;
+
+    QMutex mMutex;
+    QHash<Key, QMirClientSurfaceConfig> mConfigs;
+    uint mHits{0};
+    uint mMisses{0};
+};
+
+#endif // QMIRCLIENTEGLCONFIGCACHE_H
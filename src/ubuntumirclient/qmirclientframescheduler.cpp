@@ -0,0 +1,213 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qmirclientframescheduler.h"
+#include "qmirclientlogging.h"
+
+#include <QMutexLocker>
+
+/*
+ * QMirClientFrameScheduler - one repaint per vblank for a window.
+ *
+ * Resizes, render scale changes and the like used to post expose events the moment they happened,
+ * so after a stall the window would get a burst of them and render frames nobody gets to see.
+ * Requests are now coalesced into one expose sent at the next vblank, estimated from the refresh
+ * rate and the time of the last swap. Update requests (QWindow::requestUpdate()) share the same
+ * slots, a vblank gets either an expose or an update request. While the rendering thread hasn't
+ * swapped since the last one, vblanks are skipped rather than queueing more work for it, for a few
+ * frames at most should it not lead to a frame at all, and not at all once the window got exposed,
+ * hidden, paused or resumed since. Windows with a frame rate cap get their exposes and update
+ * requests no closer together than the cap allows, which is what applies the cap to windows
+ * rendering on the GUI thread. A paused window only gets exposes, its update requests wait until
+ * it is unpaused.
+ */
+
+namespace {
+
+// How many vblanks an expose may go without a swap before the next one is sent anyway
+const int MaxSkippedSlots = 4;
+
+// QTimer counts in milliseconds, rounding down would fire ahead of the vblank
+int toTimerMsecs(qint64 ns)
+{
+    return int((ns + 999999) / 1000000);
+}
+
+} // anonymous namespace
+
+QMirClientFrameScheduler::QMirClientFrameScheduler(const std::function<void()> &expose,
+                                                   const std::function<void()> &update)
+    : mExpose(expose)
+    , mUpdate(update)
+{
+    mClock.start();
+    mTimer.setSingleShot(true);
+    mTimer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&mTimer, &QTimer::timeout, [this]() { fire(); });
+}
+
+QMirClientFrameScheduler::~QMirClientFrameScheduler()
+{
+    qCDebug(mirclientBufferSwap, "QMirClientFrameScheduler - %llu expose(s) and %llu update request(s) sent, %llu coalesced, %llu vblank(s) skipped",
+            mExposeCount, mUpdateCount, mCoalescedCount, mSkippedSlots);
+}
+
+void QMirClientFrameScheduler::setRefreshRate(qreal refreshRate)
+{
+    if (refreshRate > 0) {
+        mRefreshRate = refreshRate;
+    }
+}
+
+void QMirClientFrameScheduler::setFrameInterval(int intervalUs)
+{
+    mFrameIntervalNs = qint64(intervalUs) * 1000;
+}
+
+void QMirClientFrameScheduler::setPaused(bool paused)
+{
+    if (mPaused == paused) {
+        return;
+    }
+    mPaused = paused;
+    exposureChanged();
+}
+
+void QMirClientFrameScheduler::exposureChanged()
+{
+    {
+        QMutexLocker lock(&mMutex);
+        mAwaitingSwap = false;
+    }
+    // A vblank being skipped waited on that swap, the pending requests can go out with the next one
+    mTimer.stop();
+    if (mExposePending || mUpdatePending) {
+        arm();
+    }
+}
+
+void QMirClientFrameScheduler::scheduleExpose()
+{
+    mExposePending = true;
+    arm();
+}
+
+void QMirClientFrameScheduler::scheduleUpdate()
+{
+    mUpdatePending = true;
+    arm();
+}
+
+void QMirClientFrameScheduler::arm()
+{
+    if (mPaused && !mExposePending) {
+        return;
+    }
+    if (mTimer.isActive()) {
+        ++mCoalescedCount;
+        return;
+    }
+
+    qint64 lastSwapNs;
+    {
+        QMutexLocker lock(&mMutex);
+        lastSwapNs = mLastSwapNs;
+    }
+
+    // Vblanks are assumed to follow each other from the last swap on
+    qint64 delayNs = 0;
+    if (lastSwapNs >= 0) {
+        const qint64 periodNs = qint64(1e9 / mRefreshRate);
+        const qint64 sinceSwapNs = mClock.nsecsElapsed() - lastSwapNs;
+        delayNs = (periodNs - sinceSwapNs % periodNs) % periodNs;
+    }
+    if (mFrameIntervalNs > 0 && mLastFrameNs >= 0) {
+        delayNs = qMax(delayNs, mLastFrameNs + mFrameIntervalNs - mClock.nsecsElapsed());
+    }
+    mTimer.start(toTimerMsecs(delayNs));
+}
+
+void QMirClientFrameScheduler::frameSwapped()
+{
+    QMutexLocker lock(&mMutex);
+    mLastSwapNs = mClock.nsecsElapsed();
+    mAwaitingSwap = false;
+}
+
+void QMirClientFrameScheduler::fire()
+{
+    const qint64 now = mClock.nsecsElapsed();
+    const qint64 periodNs = qint64(1e9 / mRefreshRate);
+
+    bool awaitingSwap;
+    {
+        QMutexLocker lock(&mMutex);
+        awaitingSwap = mAwaitingSwap;
+    }
+
+    // The last frame is still being rendered, anything rendered now would be stale before long
+    if (awaitingSwap && now - mLastFrameNs < MaxSkippedSlots * periodNs) {
+        ++mSkippedSlots;
+        qCDebug(mirclientBufferSwap, "QMirClientFrameScheduler - rendering behind, skipping a vblank (%llu so far)",
+                mSkippedSlots);
+        mTimer.start(toTimerMsecs(periodNs));
+        return;
+    }
+
+    {
+        QMutexLocker lock(&mMutex);
+        mAwaitingSwap = true;
+    }
+    // Either leads to a frame, so they don't both go out in the same vblank. Qt drops update
+    // requests until the pending one is delivered, so that one waits for the next vblank.
+    mLastFrameNs = now;
+    if (mExposePending) {
+        mExposePending = false;
+        ++mExposeCount;
+        mExpose();
+    } else if (mUpdatePending && !mPaused) {
+        mUpdatePending = false;
+        ++mUpdateCount;
+        mUpdate();
+    }
+    if (mUpdatePending) {
+        arm();
+    }
+}
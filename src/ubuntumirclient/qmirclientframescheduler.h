@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMIRCLIENTFRAMESCHEDULER_H
+#define QMIRCLIENTFRAMESCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QTimer>
+
+#include <functional>
+
+/*
+ * Paces the repaints a window asks for: at most one per vblank, in phase with its buffer swaps,
+ * and none while the previous one is still being rendered.
+ */
+class QMirClientFrameScheduler
+{
+public:
+    QMirClientFrameScheduler(const std::function<void()> &expose, const std::function<void()> &update);
+    ~QMirClientFrameScheduler();
+
+    // GUI thread only
+    void setRefreshRate(qreal refreshRate);
+    void setFrameInterval(int intervalUs); // frame rate cap, 0 for none
+    void setPaused(bool paused); // holds update requests back until unpaused
+    void exposureChanged(); // whatever went out before may never lead to a swap
+    void scheduleExpose();
+    void scheduleUpdate(); // QWindow::requestUpdate()
+
+    // Called on the rendering thread after every swap
+    void frameSwapped();
+
+private:
+    void arm();
+    void fire();
+
+    const std::function<void()> mExpose;
+    const std::function<void()> mUpdate;
+    QTimer mTimer;
+    QElapsedTimer mClock;
+    qreal mRefreshRate{60};
+    qint64 mFrameIntervalNs{0};
+    qint64 mLastFrameNs{-1}; // when the last expose or update request went out
+    bool mExposePending{false};
+    bool mUpdatePending{false};
+    bool mPaused{false};
+
+    // Guarded by mMutex, written on the rendering thread
+    QMutex mMutex;
+    qint64 mLastSwapNs{-1};
+    bool mAwaitingSwap{false};
+
+    quint64 mExposeCount{0};
+    quint64 mUpdateCount{0};
+    quint64 mCoalescedCount{0};
+    quint64 mSkippedSlots{0};
+};
+
+#endif // QMIRCLIENTFRAMESCHEDULER_H
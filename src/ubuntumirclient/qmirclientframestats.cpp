@@ -0,0 +1,219 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#include "qmirclientframestats.h"
+#include "qmirclientlogging.h"
+
+#include <QMutexLocker>
+#include <QVariantList>
+#include <QWindow>
+#include <QtMath>
+
+Q_LOGGING_CATEGORY(mirclientFrameStats, "qt.qpa.mirclient.frameStats", QtWarningMsg)
+
+namespace {
+
+// Gaps longer than this mean the window was idle rather than that frames were missed
+const qint64 idleIntervalNs = 250 * 1000000LL;
+
+const int defaultDumpIntervalMs = 5000;
+
+int dumpIntervalFromEnvironment()
+{
+    if (!qEnvironmentVariableIsSet("QTUBUNTU_FRAME_STATS_INTERVAL")) {
+        return defaultDumpIntervalMs;
+    }
+
+    bool ok;
+    const int interval = qgetenv("QTUBUNTU_FRAME_STATS_INTERVAL").toInt(&ok);
+    if (!ok || interval <= 0) {
+        qCWarning(mirclientFrameStats, "Invalid QTUBUNTU_FRAME_STATS_INTERVAL, using %dms", defaultDumpIntervalMs);
+        return defaultDumpIntervalMs;
+    }
+    return interval;
+}
+
+int dumpIntervalMs()
+{
+    static const int interval = dumpIntervalFromEnvironment();
+    return interval;
+}
+
+} // anonymous namespace
+
+const int QMirClientFrameStats::IntervalBucketLimits[QMirClientFrameStats::IntervalBuckets - 1] = {
+    8, 17, 25, 34, 50, 100
+};
+
+QMirClientFrameStats::QMirClientFrameStats(QWindow *window)
+    : mWindow(window)
+{
+    mClock.start();
+}
+
+void QMirClientFrameStats::setRefreshRate(qreal refreshRate)
+{
+    QMutexLocker lock(&mMutex);
+    if (refreshRate > 0) {
+        mRefreshRate = refreshRate;
+    }
+}
+
+void QMirClientFrameStats::recordFrameRequest()
+{
+    QMutexLocker lock(&mMutex);
+    if (mRequestedFrameNs < 0) {
+        mRequestedFrameNs = mClock.nsecsElapsed();
+    }
+}
+
+void QMirClientFrameStats::recordFrame(qint64 swapDurationNs)
+{
+    QMutexLocker lock(&mMutex);
+    const qint64 now = mClock.nsecsElapsed();
+
+    ++mFrameCount;
+    mLastSwapNs = swapDurationNs;
+    mMaxSwapNs = qMax(mMaxSwapNs, swapDurationNs);
+    mTotalSwapNs += swapDurationNs;
+
+    if (mLastFrameNs >= 0) {
+        const qint64 interval = now - mLastFrameNs;
+        const qint64 intervalMs = interval / 1000000;
+
+        int bucket = 0;
+        while (bucket < IntervalBuckets - 1 && intervalMs >= IntervalBucketLimits[bucket]) {
+            ++bucket;
+        }
+        ++mIntervalHistogram[bucket];
+
+        // A frame is late if it missed the vblank it was due for, each vblank skipped is a dropped frame.
+        // Counting from the request, windows deliberately rendering less often than the refresh rate
+        // aren't late in between.
+        const qint64 latency = now - (mRequestedFrameNs >= 0 ? mRequestedFrameNs : mLastFrameNs);
+        const qreal periodNs = 1e9 / mRefreshRate;
+        if (latency < idleIntervalNs && latency > 1.5 * periodNs) {
+            ++mLateFrames;
+            mDroppedFrames += qRound(latency / periodNs) - 1;
+        }
+    }
+    mLastFrameNs = now;
+    mRequestedFrameNs = -1;
+
+    if (mirclientFrameStats().isDebugEnabled() && now - mLastDumpNs >= dumpIntervalMs() * 1000000LL) {
+        mLastDumpNs = now;
+        dump();
+    }
+}
+
+void QMirClientFrameStats::recordResizeRepaint()
+{
+    QMutexLocker lock(&mMutex);
+    ++mResizeRepaints;
+}
+
+void QMirClientFrameStats::recordBufferRelease(quint64 bytes)
+{
+    QMutexLocker lock(&mMutex);
+    ++mBufferReleases;
+    mReleasedBufferBytes += bytes;
+}
+
+void QMirClientFrameStats::setBufferingMode(const QString &mode)
+{
+    QMutexLocker lock(&mMutex);
+    mBufferingMode = mode;
+}
+
+QVariantMap QMirClientFrameStats::toVariantMap() const
+{
+    QMutexLocker lock(&mMutex);
+
+    QVariantList histogram;
+    for (int i = 0; i < IntervalBuckets; ++i) {
+        histogram.append(mIntervalHistogram[i]);
+    }
+
+    QVariantMap stats;
+    stats.insert(QStringLiteral("frameCount"), mFrameCount);
+    stats.insert(QStringLiteral("refreshRate"), mRefreshRate);
+    stats.insert(QStringLiteral("bufferingMode"), mBufferingMode);
+    stats.insert(QStringLiteral("lastSwapDurationUs"), mLastSwapNs / 1000);
+    stats.insert(QStringLiteral("maxSwapDurationUs"), mMaxSwapNs / 1000);
+    stats.insert(QStringLiteral("averageSwapDurationUs"), mFrameCount ? mTotalSwapNs / qint64(mFrameCount) / 1000 : 0);
+    stats.insert(QStringLiteral("intervalHistogram"), histogram);
+    stats.insert(QStringLiteral("lateFrames"), mLateFrames);
+    stats.insert(QStringLiteral("droppedFrames"), mDroppedFrames);
+    stats.insert(QStringLiteral("resizeRepaints"), mResizeRepaints);
+    stats.insert(QStringLiteral("bufferReleases"), mBufferReleases);
+    stats.insert(QStringLiteral("releasedBufferKiB"), mReleasedBufferBytes / 1024);
+    return stats;
+}
+
+quint64 QMirClientFrameStats::frameCount() const
+{
+    QMutexLocker lock(&mMutex);
+    return mFrameCount;
+}
+
+quint64 QMirClientFrameStats::lateFrameCount() const
+{
+    QMutexLocker lock(&mMutex);
+    return mLateFrames;
+}
+
+void QMirClientFrameStats::dump() const
+{
+    QString histogram;
+    for (int i = 0; i < IntervalBuckets; ++i) {
+        if (i < IntervalBuckets - 1) {
+            histogram += QStringLiteral("<%1ms:%2 ").arg(IntervalBucketLimits[i]).arg(mIntervalHistogram[i]);
+        } else {
+            histogram += QStringLiteral(">=%1ms:%2").arg(IntervalBucketLimits[i - 1]).arg(mIntervalHistogram[i]);
+        }
+    }
+
+    qCDebug(mirclientFrameStats, "window=%p buffering=%s frames=%llu late=%llu dropped=%llu resizeRepaints=%llu "
+            "swap(last=%lldus, max=%lldus, avg=%lldus) intervals[%s]",
+            mWindow, qPrintable(mBufferingMode), mFrameCount, mLateFrames, mDroppedFrames, mResizeRepaints,
+            mLastSwapNs / 1000, mMaxSwapNs / 1000, mFrameCount ? mTotalSwapNs / qint64(mFrameCount) / 1000 : 0,
+            qPrintable(histogram));
+}
@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QMIRCLIENTFRAMESTATS_H
+#define QMIRCLIENTFRAMESTATS_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVariantMap>
+
+class QWindow;
+
+/*
+ * Frame accounting for one window. Frames are recorded on the render thread while the
+ * statistics are read from the GUI thread, hence the locking.
+ */
+class QMirClientFrameStats
+{
+public:
+    explicit QMirClientFrameStats(QWindow *window);
+
+    void setRefreshRate(qreal refreshRate);
+    void setBufferingMode(const QString &mode);
+
+    // The frame a window is asked for (through an expose or an update request) is due at the next
+    // vblank, one rendered without being asked for is due a refresh period after the previous one
+    void recordFrameRequest();
+    void recordFrame(qint64 swapDurationNs);
+    void recordResizeRepaint();
+    // Buffers given back by a hidden window, whose stream is reallocated at 1x1
+    void recordBufferRelease(quint64 bytes);
+
+    QVariantMap toVariantMap() const;
+    quint64 frameCount() const;
+    quint64 lateFrameCount() const;
+
+private:
+    void dump() const;
+
+    // Upper bounds (in ms) of the inter-frame interval histogram buckets, the last one is open ended
+    static const int IntervalBuckets = 7;
+    static const int IntervalBucketLimits[IntervalBuckets - 1];
+
+    QWindow * const mWindow;
+    mutable QMutex mMutex;
+    QElapsedTimer mClock;
+
+    qreal mRefreshRate{60};
+    QString mBufferingMode;
+    quint64 mFrameCount{0};
+    qint64 mLastFrameNs{-1};
+    qint64 mRequestedFrameNs{-1}; // oldest request not answered by a frame yet
+    qint64 mLastDumpNs{0};
+
+    qint64 mLastSwapNs{0};
+    qint64 mMaxSwapNs{0};
+    qint64 mTotalSwapNs{0};
+
+    quint64 mIntervalHistogram[IntervalBuckets] = {};
+    quint64 mLateFrames{0};
+    quint64 mDroppedFrames{0};
+    quint64 mResizeRepaints{0};
+    quint64 mBufferReleases{0};
+    quint64 mReleasedBufferBytes{0};
+};
+
+#endif // QMIRCLIENTFRAMESTATS_H
@@ -42,7 +42,9 @@
 #include "qmirclientlogging.h"
 #include "qmirclientwindow.h"
 
+#include <QElapsedTimer>
 #include <QOpenGLFramebufferObject>
+#include <QtMath>
 #include <QtPlatformSupport/private/qeglconvenience_p.h>
 #include <QtPlatformSupport/private/qeglpbuffer_p.h>
 #include <QtGui/private/qopenglcontext_p.h>
@@ -69,11 +71,78 @@ void printEglConfig(EGLDisplay display, EGLConfig config)
     q_printEglConfig(display, config);
 }
 
+typedef EGLBoolean (EGLAPIENTRYP SwapBuffersWithDamageProc)(EGLDisplay display, EGLSurface surface,
+                                                             EGLint *rects, EGLint rectCount);
+
+// From EGL_KHR_swap_buffers_with_damage or the EXT extension it was promoted from, null if neither
+SwapBuffersWithDamageProc swapBuffersWithDamageProc(EGLDisplay display)
+{
+    static const SwapBuffersWithDamageProc proc = [display]() -> SwapBuffersWithDamageProc {
+        SwapBuffersWithDamageProc resolved = nullptr;
+        if (q_hasEglExtension(display, "EGL_KHR_swap_buffers_with_damage")) {
+            resolved = reinterpret_cast<SwapBuffersWithDamageProc>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+        }
+        if (!resolved && q_hasEglExtension(display, "EGL_EXT_swap_buffers_with_damage")) {
+            resolved = reinterpret_cast<SwapBuffersWithDamageProc>(eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+        }
+        qCDebug(mirclientGraphics, "Swap buffers with damage %s", resolved ? "supported" : "not supported");
+        return resolved;
+    }();
+    return proc;
+}
+
+// Lets the compositor only recompose what changed. Returns false if the caller should swap the
+// usual way, i.e. when there is no damage to tell or EGL can't be told about it.
+bool swapBuffersWithDamage(EGLDisplay display, QMirClientWindow *window)
+{
+    const QRegion damage = window->takeSwapDamage();
+    const auto swapWithDamage = swapBuffersWithDamageProc(display);
+    const EGLSurface surface = window->eglSurface();
+    if (damage.isEmpty() || !swapWithDamage || surface == EGL_NO_SURFACE) {
+        return false;
+    }
+
+    EGLint width = 0;
+    EGLint height = 0;
+    eglQuerySurface(display, surface, EGL_WIDTH, &width);
+    eglQuerySurface(display, surface, EGL_HEIGHT, &height);
+    const QRect bufferRect(0, 0, width, height);
+
+    // Damage is in window coordinates, EGL wants buffer pixels with the origin at the bottom left
+    const qreal scale = window->renderScale();
+    QVector<EGLint> rects;
+    rects.reserve(damage.rectCount() * 4);
+    qint64 damagedArea = 0;
+    for (const QRect &rect : damage.rects()) {
+        const QRect bufferDamage = bufferRect & QRect(QPoint(qFloor(rect.left() * scale), qFloor(rect.top() * scale)),
+                                                      QPoint(qCeil((rect.right() + 1) * scale) - 1,
+                                                             qCeil((rect.bottom() + 1) * scale) - 1));
+        if (bufferDamage.isEmpty()) {
+            continue;
+        }
+        rects << bufferDamage.x() << height - bufferDamage.y() - bufferDamage.height()
+              << bufferDamage.width() << bufferDamage.height();
+        damagedArea += qint64(bufferDamage.width()) * bufferDamage.height();
+    }
+    if (rects.isEmpty()) {
+        return false;
+    }
+
+    if (!swapWithDamage(display, surface, rects.data(), rects.size() / 4)) {
+        qWarning("QMirClientOpenGLContext: eglSwapBuffersWithDamage failed: %x", eglGetError());
+        return false;
+    }
+
+    qCDebug(mirclientBufferSwap, "swapBuffersWithDamage(window=%p) - %d rect(s), %.1f%% of the surface",
+            window->window(), rects.size() / 4, bufferRect.isEmpty() ? 0.0 : 100.0 * damagedArea / (width * height));
+    return true;
+}
+
 } // anonymous namespace
 
 QMirClientOpenGLContext::QMirClientOpenGLContext(const QSurfaceFormat &format, QPlatformOpenGLContext *share,
-                                         EGLDisplay display)
-    : QEGLPlatformContext(format, share, display, 0)
+                                         EGLDisplay display, EGLConfig *config)
+    : QEGLPlatformContext(format, share, display, config)
 {
     if (mirclientGraphics().isDebugEnabled()) {
         printEglConfig(display, eglConfig());
@@ -96,19 +165,55 @@ static bool needsFBOReadBackWorkaround()
     return needsWorkaround;
 }
 
+// The window whose surface is current, if any. QOpenGLContext only updates it after the platform
+// context is done making a surface current or not current.
+static QMirClientWindow *currentWindow(QOpenGLContext *context)
+{
+    QSurface *surface = context->surface();
+    if (!surface || surface->surfaceClass() != QSurface::Window) {
+        return nullptr;
+    }
+    return static_cast<QMirClientWindow *>(surface->surfaceHandle());
+}
+
 bool QMirClientOpenGLContext::makeCurrent(QPlatformSurface* surface)
 {
+    // Windows need to know while their surface is current, see QMirClientWindow::doneCurrent()
+    QMirClientWindow *window = surface->surface()->surfaceClass() == QSurface::Window
+            ? static_cast<QMirClientWindow *>(surface) : nullptr;
+    QMirClientWindow *previousWindow = currentWindow(context());
+    if (window) {
+        window->aboutToMakeCurrent();
+    }
+
     const bool ret = QEGLPlatformContext::makeCurrent(surface);
 
+    QMirClientWindow *notCurrent = ret ? previousWindow : window;
+    if (notCurrent && previousWindow != window) {
+        notCurrent->doneCurrent();
+    }
+
     if (Q_LIKELY(ret)) {
         QOpenGLContextPrivate *ctx_d = QOpenGLContextPrivate::get(context());
         if (!ctx_d->workaround_brokenFBOReadBack && needsFBOReadBackWorkaround()) {
             ctx_d->workaround_brokenFBOReadBack = true;
         }
+
+        if (window) {
+            window->syncSwapInterval();
+        }
     }
     return ret;
 }
 
+void QMirClientOpenGLContext::doneCurrent()
+{
+    QEGLPlatformContext::doneCurrent();
+    if (QMirClientWindow *window = currentWindow(context())) {
+        window->doneCurrent();
+    }
+}
+
 // Following method used internally in the base class QEGLPlatformContext to access
 // the egl surface of a QPlatformSurface/QMirClientWindow
 EGLSurface QMirClientOpenGLContext::eglSurfaceForPlatformSurface(QPlatformSurface *surface)
@@ -122,11 +227,22 @@ EGLSurface QMirClientOpenGLContext::eglSurfaceForPlatformSurface(QPlatformSurfac
 
 void QMirClientOpenGLContext::swapBuffers(QPlatformSurface *surface)
 {
-    QEGLPlatformContext::swapBuffers(surface);
+    const bool isWindow = surface->surface()->surfaceClass() == QSurface::Window;
+    if (isWindow) {
+        // hold the frame back if the window has a frame rate cap and renders on a thread of its own
+        static_cast<QMirClientWindow *>(surface)->waitForFrameSlot();
+    }
 
-    if (surface->surface()->surfaceClass() == QSurface::Window) {
+    QElapsedTimer swapTimer;
+    swapTimer.start();
+
+    if (!isWindow || !swapBuffersWithDamage(eglDisplay(), static_cast<QMirClientWindow *>(surface))) {
+        QEGLPlatformContext::swapBuffers(surface);
+    }
+
+    if (isWindow) {
         // notify window on swap completion
         auto platformWindow = static_cast<QMirClientWindow *>(surface);
-        platformWindow->onSwapBuffersDone();
+        platformWindow->onSwapBuffersDone(swapTimer.nsecsElapsed());
     }
 }
@@ -50,11 +50,12 @@ class QMirClientOpenGLContext : public QEGLPlatformContext
 {
 public:
     QMirClientOpenGLContext(const QSurfaceFormat &format, QPlatformOpenGLContext *share,
-                        EGLDisplay display);
+                        EGLDisplay display, EGLConfig *config = nullptr);
 
     // QEGLPlatformContext methods.
     void swapBuffers(QPlatformSurface *surface) final;
     bool makeCurrent(QPlatformSurface *surface) final;
+    void doneCurrent() final;
 
 protected:
     EGLSurface eglSurfaceForPlatformSurface(QPlatformSurface *surface) final;
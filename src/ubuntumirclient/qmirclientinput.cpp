@@ -44,6 +44,7 @@
 #include "qmirclientnativeinterface.h"
 #include "qmirclientscreen.h"
 #include "qmirclientwindow.h"
+#include "qmirclientwindowregistry.h"
 #include "qmirclientlogging.h"
 #include "qmirclientorientationchangeevent_p.h"
 
@@ -193,8 +194,8 @@ Qt::WindowState mirWindowStateToQt(MirWindowState state)
 class UbuntuEvent : public QEvent
 {
 public:
-    UbuntuEvent(QMirClientWindow* window, const MirEvent *event, QEvent::Type type)
-        : QEvent(type), window(window) {
+    UbuntuEvent(WId windowId, const MirEvent *event, QEvent::Type type)
+        : QEvent(type), windowId(windowId) {
         nativeEvent = mir_event_ref(event);
     }
     ~UbuntuEvent()
@@ -202,7 +203,8 @@ public:
         mir_event_unref(nativeEvent);
     }
 
-    QPointer<QMirClientWindow> window;
+    // Posted from Mir threads, the window is only looked up once the event is dispatched
+    WId windowId;
     const MirEvent *nativeEvent;
 };
 
@@ -212,7 +214,7 @@ QMirClientInput::QMirClientInput(QMirClientClientIntegration* integration)
     , mEventFilterType(static_cast<QMirClientNativeInterface*>(
         integration->nativeInterface())->genericEventFilterType())
     , mEventType(static_cast<QEvent::Type>(QEvent::registerEventType()))
-    , mLastInputWindow(nullptr)
+    , mLastInputWindowId(0)
 {
     // Initialize touch device.
     mTouchDevice = new QTouchDevice;
@@ -268,15 +270,23 @@ void QMirClientInput::customEvent(QEvent* event)
     UbuntuEvent* ubuntuEvent = static_cast<UbuntuEvent*>(event);
     const MirEvent *nativeEvent = ubuntuEvent->nativeEvent;
 
-    if ((ubuntuEvent->window == nullptr) || (ubuntuEvent->window->window() == nullptr)) {
+    QMirClientWindow *window = mIntegration->windowRegistry()->windowForId(ubuntuEvent->windowId);
+    if ((window == nullptr) || (window->window() == nullptr)) {
         qCWarning(mirclient) << "Attempted to deliver an event to a non-existent window, ignoring.";
         return;
     }
 
+    // Resize events are coalesced, the window holds the latest size Mir sent. Take it before
+    // filtering so that a filtered event doesn't leave the window waiting for it forever.
+    QSize resizeSize;
+    if (mir_event_get_type(nativeEvent) == mir_event_type_resize) {
+        resizeSize = window->takePendingResize();
+    }
+
     // Event filtering.
     long result;
     if (QWindowSystemInterface::handleNativeEvent(
-            ubuntuEvent->window->window(), mEventFilterType,
+            window->window(), mEventFilterType,
             const_cast<void *>(static_cast<const void *>(nativeEvent)), &result) == true) {
         qCDebug(mirclient, "event filtered out by native interface");
         return;
@@ -288,39 +298,41 @@ void QMirClientInput::customEvent(QEvent* event)
     switch (mir_event_get_type(nativeEvent))
     {
     case mir_event_type_input:
-        dispatchInputEvent(ubuntuEvent->window, mir_event_get_input_event(nativeEvent));
+        dispatchInputEvent(window, mir_event_get_input_event(nativeEvent));
         break;
     case mir_event_type_resize:
     {
-        auto resizeEvent = mir_event_get_resize_event(nativeEvent);
-
-        // Enable workaround for Screen rotation
-        auto const targetWindow = ubuntuEvent->window;
+        auto const targetWindow = window;
         if (targetWindow) {
+            const QSize size = resizeSize;
+            if (!size.isValid()) {
+                break;
+            }
+
+            // Enable workaround for Screen rotation
             auto const screen = static_cast<QMirClientScreen*>(targetWindow->screen());
             if (screen) {
-                screen->handleWindowSurfaceResize(
-                        mir_resize_event_get_width(resizeEvent),
-                        mir_resize_event_get_height(resizeEvent));
+                screen->handleWindowSurfaceResize(size.width(), size.height());
             }
 
-            targetWindow->handleSurfaceResized(
-                        mir_resize_event_get_width(resizeEvent),
-                        mir_resize_event_get_height(resizeEvent));
+            targetWindow->handleSurfaceResized(size.width(), size.height());
         }
         break;
     }
     case mir_event_type_window:
-        handleWindowEvent(ubuntuEvent->window, mir_event_get_window_event(nativeEvent));
+        handleWindowEvent(window, mir_event_get_window_event(nativeEvent));
         break;
     case mir_event_type_window_output:
-        handleWindowOutputEvent(ubuntuEvent->window, mir_event_get_window_output_event(nativeEvent));
+        handleWindowOutputEvent(window, mir_event_get_window_output_event(nativeEvent));
         break;
     case mir_event_type_orientation:
-        dispatchOrientationEvent(ubuntuEvent->window->window(), mir_event_get_orientation_event(nativeEvent));
+        dispatchOrientationEvent(window->window(), mir_event_get_orientation_event(nativeEvent));
         break;
     case mir_event_type_close_window:
-        QWindowSystemInterface::handleCloseEvent(ubuntuEvent->window->window());
+        QWindowSystemInterface::handleCloseEvent(window->window());
+        break;
+    case mir_event_type_window_placement:
+        window->handleSurfacePlacementChanged();
         break;
     default:
         qCDebug(mirclient, "unhandled event type: %d", static_cast<int>(mir_event_get_type(nativeEvent)));
@@ -332,15 +344,21 @@ void QMirClientInput::postEvent(QMirClientWindow *platformWindow, const MirEvent
     QWindow *window = platformWindow->window();
 
     QCoreApplication::postEvent(this, new UbuntuEvent(
-            platformWindow, event, mEventType));
+            platformWindow->winId(), event, mEventType));
 
     if ((window->flags().testFlag(Qt::WindowTransparentForInput)) && window->parent()) {
         QCoreApplication::postEvent(this, new UbuntuEvent(
-                    static_cast<QMirClientWindow*>(platformWindow->QPlatformWindow::parent()),
+                    platformWindow->QPlatformWindow::parent()->winId(),
                     event, mEventType));
     }
 }
 
+// Looked up rather than kept as a pointer, the window may be gone by now
+QMirClientWindow *QMirClientInput::lastInputWindow() const
+{
+    return mIntegration->windowRegistry()->windowForId(mLastInputWindowId);
+}
+
 void QMirClientInput::dispatchInputEvent(QMirClientWindow *window, const MirInputEvent *ev)
 {
     switch (mir_input_event_get_type(ev))
@@ -390,7 +408,7 @@ void QMirClientInput::dispatchTouchEvent(QMirClientWindow *window, const MirInpu
         switch (touch_action)
         {
         case mir_touch_action_down:
-            mLastInputWindow = window;
+            mLastInputWindowId = window->winId();
             touchPoint.state = Qt::TouchPointPressed;
             break;
         case mir_touch_action_up:
@@ -474,7 +492,7 @@ void QMirClientInput::dispatchKeyEvent(QMirClientWindow *window, const MirInputE
         ? QEvent::KeyRelease : QEvent::KeyPress;
 
     if (action == mir_keyboard_action_down)
-        mLastInputWindow = window;
+        mLastInputWindowId = window->winId();
 
     QString text;
     QVarLengthArray<char, 32> chars(32);
@@ -534,7 +552,7 @@ void QMirClientInput::dispatchPointerEvent(QMirClientWindow *platformWindow, con
     const auto localPoint = QPointF(mir_pointer_event_axis_value(pev, mir_pointer_axis_x),
                                     mir_pointer_event_axis_value(pev, mir_pointer_axis_y));
 
-    mLastInputWindow = platformWindow;
+    mLastInputWindowId = platformWindow->winId();
 
     switch (action) {
     case mir_pointer_action_button_up:
@@ -646,8 +664,12 @@ void QMirClientInput::handleWindowEvent(const QPointer<QMirClientWindow> &window
         }
         break;
     }
+    case mir_window_attrib_swapinterval: {
+        // The compositor's answer to the interval we asked for
+        window->handleSwapIntervalChanged(mir_window_event_get_attribute_value(event));
+        break;
+    }
     case mir_window_attrib_type:
-    case mir_window_attrib_swapinterval:
     case mir_window_attrib_dpi:
     case mir_window_attrib_preferred_orientation:
     case mir_window_attribs:
@@ -670,7 +692,7 @@ void QMirClientInput::handleWindowOutputEvent(const QPointer<QMirClientWindow> &
     }
 
     screenObserver->handleScreenPropertiesChange(screen, dpi, formFactor, scale);
-    window->handleScreenPropertiesChange(formFactor, scale);
+    window->handleScreenPropertiesChange(formFactor, scale, screen->refreshRate());
 
     if (window->screen() != screen) {
         QWindowSystemInterface::handleWindowScreenChanged(window->window(), screen->screen());
@@ -62,7 +62,7 @@ public:
 
     void postEvent(QMirClientWindow* window, const MirEvent *event);
     QMirClientClientIntegration* integration() const { return mIntegration; }
-    QMirClientWindow *lastInputWindow() const {return mLastInputWindow; }
+    QMirClientWindow *lastInputWindow() const;
 
 protected:
     void dispatchKeyEvent(QMirClientWindow *window, const MirInputEvent *event);
@@ -80,7 +80,7 @@ private:
     const QByteArray mEventFilterType;
     const QEvent::Type mEventType;
 
-    QMirClientWindow *mLastInputWindow;
+    WId mLastInputWindowId;
 };
 
 #endif // QMIRCLIENTINPUT_H
@@ -44,12 +44,17 @@
 #include "qmirclientclipboard.h"
 #include "qmirclientdebugextension.h"
 #include "qmirclientdesktopwindow.h"
+#include "qmirclienteglconfigcache.h"
 #include "qmirclientglcontext.h"
 #include "qmirclientinput.h"
 #include "qmirclientlogging.h"
 #include "qmirclientnativeinterface.h"
 #include "qmirclientscreen.h"
+#include "qmirclientspeculativewindow.h"
+#include "qmirclientsurfacepool.h"
+#include "qmirclientsurfacereaper.h"
 #include "qmirclientwindow.h"
+#include "qmirclientwindowregistry.h"
 #include "../shared/ubuntutheme.h"
 
 // Qt
@@ -134,6 +139,14 @@ QMirClientClientIntegration::QMirClientClientIntegration(int argc, char **argv)
     ASSERT((mEglDisplay = eglGetDisplay(mEglNativeDisplay)) != EGL_NO_DISPLAY);
     ASSERT(eglInitialize(mEglDisplay, nullptr, nullptr) == EGL_TRUE);
 
+    mEglConfigCache.reset(new QMirClientEglConfigCache(mEglDisplay, mMirConnection));
+    mWindowRegistry.reset(new QMirClientWindowRegistry);
+
+    // Windows hand their surfaces over to the reaper when destroyed
+    mSurfaceReaper.reset(new QMirClientSurfaceReaper);
+    // or, for popups and tooltips, to the pool where new ones can pick them up
+    mSurfacePool.reset(new QMirClientSurfacePool(mEglDisplay, mSurfaceReaper.data()));
+
     // Has debug mode been requsted, either with "-testability" switch or QT_LOAD_TESTABILITY env var
     bool testability = qEnvironmentVariableIsSet("QT_LOAD_TESTABILITY");
     for (int i=1; !testability && i<argc; i++) {
@@ -162,6 +175,16 @@ void QMirClientClientIntegration::initialize()
         screenAdded(screen);
     }
 
+    // Get the main window going while the application starts up
+    if (QMirClientSpeculativeWindow::isEnabled() && !mScreenObserver->screens().isEmpty()) {
+        const QSize screenSize = mScreenObserver->screens().first()->geometry().size();
+        mSpeculativeWindow.reset(new QMirClientSpeculativeWindow(
+                [this, screenSize](QMirClientSurfacePool::Key *key) {
+                    return QMirClientWindow::createSpeculativeSurface(mMirConnection, mEglDisplay,
+                                                                      mEglConfigCache.data(), screenSize, key);
+                }, mEglDisplay, mSurfaceReaper.data()));
+    }
+
     // Initialize input.
     mInput = new QMirClientInput(this);
     mInputContext = QPlatformInputContextFactory::create();
@@ -182,6 +205,10 @@ void QMirClientClientIntegration::initialize()
 
 QMirClientClientIntegration::~QMirClientClientIntegration()
 {
+    // Must finish releasing surfaces before the display goes away
+    mSpeculativeWindow.reset();
+    mSurfacePool.reset();
+    mSurfaceReaper.reset();
     eglTerminate(mEglDisplay);
     delete mInput;
     delete mInputContext;
@@ -301,9 +328,13 @@ QPlatformBackingStore* QMirClientClientIntegration::createPlatformBackingStore(Q
 QPlatformOpenGLContext* QMirClientClientIntegration::createPlatformOpenGLContext(
         QOpenGLContext* context) const
 {
-    QSurfaceFormat format(context->format());
+    // Reuse the EGLConfig already chosen for windows of the same format, if any
+    const auto surfaceConfig = mEglConfigCache->configForFormat(context->format());
+    QSurfaceFormat format(surfaceConfig.format);
+    EGLConfig config = surfaceConfig.config;
 
-    auto platformContext = new QMirClientOpenGLContext(format, context->shareHandle(), mEglDisplay);
+    auto platformContext = new QMirClientOpenGLContext(format, context->shareHandle(), mEglDisplay,
+                                                       config ? &config : nullptr);
     if (!platformContext->isValid()) {
         // Older Intel Atom-based devices only support OpenGL 1.4 compatibility profile but by default
         // QML asks for at least OpenGL 2.0. The XCB GLX backend ignores this request and returns a
@@ -55,9 +55,14 @@
 #include <EGL/egl.h>
 
 class QMirClientDebugExtension;
+class QMirClientEglConfigCache;
 class QMirClientInput;
 class QMirClientNativeInterface;
 class QMirClientScreen;
+class QMirClientSpeculativeWindow;
+class QMirClientSurfacePool;
+class QMirClientSurfaceReaper;
+class QMirClientWindowRegistry;
 struct MirConnection;
 
 class QMirClientClientIntegration : public QObject, public QPlatformIntegration
@@ -93,6 +98,11 @@ public:
     QMirClientAppStateController *appStateController() const { return mAppStateController.data(); }
     QMirClientScreenObserver *screenObserver() const { return mScreenObserver.data(); }
     QMirClientDebugExtension *debugExtension() const { return mDebugExtension.data(); }
+    QMirClientSurfaceReaper *surfaceReaper() const { return mSurfaceReaper.data(); }
+    QMirClientSurfacePool *surfacePool() const { return mSurfacePool.data(); }
+    QMirClientSpeculativeWindow *speculativeWindow() const { return mSpeculativeWindow.data(); }
+    QMirClientWindowRegistry *windowRegistry() const { return mWindowRegistry.data(); }
+    QMirClientEglConfigCache *eglConfigCache() const { return mEglConfigCache.data(); }
 
 private Q_SLOTS:
     void destroyScreen(QMirClientScreen *screen);
@@ -114,6 +124,11 @@ private:
     QScopedPointer<QMirClientDebugExtension> mDebugExtension;
     QScopedPointer<QMirClientScreenObserver> mScreenObserver;
     QScopedPointer<QMirClientAppStateController> mAppStateController;
+    QScopedPointer<QMirClientSurfaceReaper> mSurfaceReaper;
+    QScopedPointer<QMirClientSurfacePool> mSurfacePool;
+    QScopedPointer<QMirClientSpeculativeWindow> mSpeculativeWindow;
+    QScopedPointer<QMirClientWindowRegistry> mWindowRegistry;
+    QScopedPointer<QMirClientEglConfigCache> mEglConfigCache;
     qreal mScaleFactor;
 
     MirConnection *mMirConnection;
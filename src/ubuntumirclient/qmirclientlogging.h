@@ -51,5 +51,6 @@ Q_DECLARE_LOGGING_CATEGORY(mirclientInput)
 Q_DECLARE_LOGGING_CATEGORY(mirclientGraphics)
 Q_DECLARE_LOGGING_CATEGORY(mirclientCursor)
 Q_DECLARE_LOGGING_CATEGORY(mirclientDebug)
+Q_DECLARE_LOGGING_CATEGORY(mirclientFrameStats)
 
 #endif  // QMIRCLIENTLOGGING_H
@@ -42,6 +42,7 @@
 #include "qmirclientnativeinterface.h"
 #include "qmirclientscreen.h"
 #include "qmirclientglcontext.h"
+#include "qmirclientlogging.h"
 #include "qmirclientwindow.h"
 
 // Qt
@@ -187,6 +188,13 @@ QVariantMap QMirClientNativeInterface::windowProperties(QPlatformWindow *window)
         propertyMap.insert("scale", w->scale());
         propertyMap.insert("formFactor", w->formFactor());
         propertyMap.insert("persistentSurfaceId", w->persistentSurfaceId());
+        propertyMap.insert("frameStats", w->frameStats());
+        propertyMap.insert("swapInterval", w->swapInterval());
+        propertyMap.insert("targetFrameRate", w->targetFrameRate());
+        propertyMap.insert("renderScale", w->renderScale());
+        propertyMap.insert("bufferingMode", w->bufferingMode());
+        propertyMap.insert("reportSwapTiming", w->reportsSwapTiming());
+        propertyMap.insert("swapTiming", w->swapTiming());
     }
     return propertyMap;
 }
@@ -204,6 +212,20 @@ QVariant QMirClientNativeInterface::windowProperty(QPlatformWindow *window, cons
         return w->formFactor();
     }  else if (name == QStringLiteral("persistentSurfaceId")) {
         return w->persistentSurfaceId();
+    } else if (name == QStringLiteral("frameStats")) {
+        return w->frameStats();
+    } else if (name == QStringLiteral("swapInterval")) {
+        return w->swapInterval();
+    } else if (name == QStringLiteral("targetFrameRate")) {
+        return w->targetFrameRate();
+    } else if (name == QStringLiteral("renderScale")) {
+        return w->renderScale();
+    } else if (name == QStringLiteral("bufferingMode")) {
+        return w->bufferingMode();
+    } else if (name == QStringLiteral("reportSwapTiming")) {
+        return w->reportsSwapTiming();
+    } else if (name == QStringLiteral("swapTiming")) {
+        return w->swapTiming();
     } else {
         return QVariant();
     }
@@ -218,3 +240,56 @@ QVariant QMirClientNativeInterface::windowProperty(QPlatformWindow *window, cons
         return returnVal;
     }
 }
+
+// "swapInterval" (vsyncs per frame, 0 to run unthrottled) and "targetFrameRate" (frames per
+// second, 0 for no cap) are per-window and override QT_QPA_EGLFS_SWAPINTERVAL. "renderScale"
+// (fraction of the window size its buffers are allocated at, up to 1) overrides QTUBUNTU_RENDER_SCALE.
+// "swapDamage" (QRegion or QRect) is the part of the window the next frame changes, write only.
+// With "reportSwapTiming" set, "swapTiming" changes with every frame; frames swapped before the GUI
+// thread gets to notify of one are only notified of once.
+// "bufferingMode" is either "low-latency" or "default", see QMirClientWindow.
+void QMirClientNativeInterface::setWindowProperty(QPlatformWindow *window, const QString &name, const QVariant &value)
+{
+    auto w = static_cast<QMirClientWindow*>(window);
+    if (!w) {
+        return;
+    }
+
+    bool ok = false;
+    if (name == QStringLiteral("swapInterval")) {
+        const int interval = value.toInt(&ok);
+        if (ok && interval >= 0) {
+            w->setSwapInterval(interval);
+        } else {
+            qCWarning(mirclient) << "Invalid swapInterval" << value << "for window" << w->window();
+        }
+    } else if (name == QStringLiteral("targetFrameRate")) {
+        const qreal frameRate = value.toReal(&ok);
+        if (ok && frameRate >= 0) {
+            w->setTargetFrameRate(frameRate);
+        } else {
+            qCWarning(mirclient) << "Invalid targetFrameRate" << value << "for window" << w->window();
+        }
+    } else if (name == QStringLiteral("renderScale")) {
+        const qreal scale = value.toReal(&ok);
+        if (ok && scale > 0 && scale <= 1) {
+            w->setRenderScale(scale);
+        } else {
+            qCWarning(mirclient) << "Invalid renderScale" << value << "for window" << w->window();
+        }
+    } else if (name == QStringLiteral("swapDamage")) {
+        if (value.canConvert<QRegion>()) {
+            w->addSwapDamage(value.value<QRegion>());
+        } else if (value.canConvert<QRect>()) {
+            w->addSwapDamage(value.toRect());
+        } else {
+            qCWarning(mirclient) << "Invalid swapDamage" << value << "for window" << w->window();
+        }
+    } else if (name == QStringLiteral("bufferingMode")) {
+        if (!w->setBufferingMode(value.toString())) {
+            qCWarning(mirclient) << "Invalid bufferingMode" << value << "for window" << w->window();
+        }
+    } else if (name == QStringLiteral("reportSwapTiming")) {
+        w->setReportSwapTiming(value.toBool());
+    }
+}
@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qmirclientspeculativewindow.h"
+#include "qmirclientlogging.h"
+#include "qmirclientsurfacereaper.h"
+
+#include <QElapsedTimer>
+
+/*
+ * QMirClientSpeculativeWindow - a head start for the main window.
+ *
+ * Nothing surface related happens until the application creates its first window, which QML
+ * applications only do once the engine has loaded and compiled the scene. The hidden window
+ * made here is sized to the primary screen with the format QtQuick asks for, so that a QML main
+ * window can adopt it and only needs a spec for its actual geometry and title. Any other first
+ * window has it released instead, as has a main window that comes before the creation finished:
+ * that one creates its own window rather than wait on the server with the GUI thread.
+ */
+
+QMirClientSpeculativeWindow::QMirClientSpeculativeWindow(const Creator &create, EGLDisplay display,
+                                                         QMirClientSurfaceReaper *reaper)
+    : mCreate(create)
+    , mEglDisplay(display)
+    , mReaper(reaper)
+{
+    setObjectName(QStringLiteral("QMirClientSpeculativeWindow"));
+    start();
+}
+
+QMirClientSpeculativeWindow::~QMirClientSpeculativeWindow()
+{
+    wait();
+    // A window taken before or after the creation finished was released or handed over already
+    if (!mTaken) {
+        release();
+    }
+}
+
+bool QMirClientSpeculativeWindow::isEnabled()
+{
+    static const bool enabled = qEnvironmentVariableIsSet("QTUBUNTU_SPECULATIVE_WINDOW");
+    return enabled;
+}
+
+void QMirClientSpeculativeWindow::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    QMirClientSurfacePool::Key key;
+    const auto surface = mCreate(&key);
+    qCDebug(mirclient, "QMirClientSpeculativeWindow - created Mir window %p in %lldms",
+            surface.window, timer.elapsed());
+
+    // Creating the EGL surface gave this thread EGL state of its own
+    eglReleaseThread();
+
+    QMutexLocker lock(&mMutex);
+    mKey = key;
+    mSurface = surface;
+    mCreated = true;
+    if (mTaken) {
+        qCDebug(mirclient, "QMirClientSpeculativeWindow - the main window didn't wait for it, releasing it");
+        release();
+    }
+}
+
+bool QMirClientSpeculativeWindow::take(const QMirClientSurfacePool::Key &key, QMirClientSurfacePool::Surface *surface)
+{
+    QMutexLocker lock(&mMutex);
+    if (mTaken) {
+        return false;
+    }
+    mTaken = true;
+
+    if (!mCreated) {
+        // Left for run() to release once the creation finishes
+        qCDebug(mirclient, "QMirClientSpeculativeWindow - still being created, not waiting for it");
+        return false;
+    }
+
+    if (!mSurface.window || mSurface.eglSurface == EGL_NO_SURFACE || !(key == mKey)) {
+        qCDebug(mirclient, "QMirClientSpeculativeWindow - not suitable for the main window, releasing it");
+        release();
+        return false;
+    }
+
+    qCDebug(mirclient, "QMirClientSpeculativeWindow - handed over to the main window");
+    *surface = mSurface;
+    mSurface = QMirClientSurfacePool::Surface{};
+    return true;
+}
+
+void QMirClientSpeculativeWindow::release()
+{
+    if (mSurface.window || mSurface.eglSurface != EGL_NO_SURFACE) {
+        mReaper->reap(mEglDisplay, mSurface.eglSurface, mSurface.window, mSurface.context);
+    }
+    mSurface = QMirClientSurfacePool::Surface{};
+}
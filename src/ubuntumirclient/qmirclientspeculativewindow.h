@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMIRCLIENTSPECULATIVEWINDOW_H
+#define QMIRCLIENTSPECULATIVEWINDOW_H
+
+#include <QMutex>
+#include <QThread>
+
+#include "qmirclientsurfacepool.h"
+
+#include <functional>
+
+class QMirClientSurfaceReaper;
+
+/*
+ * A main window created ahead of time on a helper thread, for the first top-level window of the
+ * application to adopt (opt-in with QTUBUNTU_SPECULATIVE_WINDOW). The server round trips then
+ * overlap with whatever the application does before creating its window, like loading QML.
+ */
+class QMirClientSpeculativeWindow : public QThread
+{
+public:
+    // Creates the window, returning its key for matching and the surface
+    using Creator = std::function<QMirClientSurfacePool::Surface(QMirClientSurfacePool::Key *key)>;
+
+    QMirClientSpeculativeWindow(const Creator &create, EGLDisplay display, QMirClientSurfaceReaper *reaper);
+    ~QMirClientSpeculativeWindow();
+
+    static bool isEnabled();
+
+    // GUI thread only. Only the first window asking gets a chance and only if the creation has
+    // finished by then, otherwise the surface is released as soon as it has. Returns false if
+    // the window wasn't handed over, the caller then creates its own.
+    bool take(const QMirClientSurfacePool::Key &key, QMirClientSurfacePool::Surface *surface);
+
+protected:
+    void run() override;
+
+private:
+    void release();
+
+    const Creator mCreate;
+    const EGLDisplay mEglDisplay;
+    QMirClientSurfaceReaper * const mReaper;
+
+    // Guards the hand over between take() and the end of run()
+    QMutex mMutex;
+    QMirClientSurfacePool::Key mKey{};
+    QMirClientSurfacePool::Surface mSurface{};
+    bool mCreated{false};
+    bool mTaken{false};
+};
+
+#endif // QMIRCLIENTSPECULATIVEWINDOW_H
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#include "qmirclientsurfacepool.h"
+#include "qmirclientlogging.h"
+#include "qmirclientsurfacereaper.h"
+
+#include <mir_toolkit/mir_client_library.h>
+
+/*
+ * QMirClientSurfacePool - keeps hidden popup, menu and tooltip surfaces around for reuse.
+ *
+ * Hovering across a toolbar shows and destroys tooltips at a high rate, each one costing a
+ * MirWindow and EGL surface created and released through the server. Instead of being released,
+ * hidden surfaces of those types wait here for a new window with the same type, EGL config,
+ * pixel format and parent, which then only needs a spec to resize and place them.
+ *
+ * The pool holds at most QTUBUNTU_SURFACE_POOL_SIZE surfaces (4 by default, 0 disables it) and
+ * releases the ones nobody took within a few seconds.
+ */
+
+namespace {
+
+const int idleTimeoutMs = 5000;
+
+int maxPoolSize()
+{
+    return qEnvironmentVariableIsSet("QTUBUNTU_SURFACE_POOL_SIZE")
+            ? qMax(0, qgetenv("QTUBUNTU_SURFACE_POOL_SIZE").toInt()) : 4;
+}
+
+} // anonymous namespace
+
+bool QMirClientSurfacePool::Key::operator==(const Key &other) const
+{
+    return type == other.type && config == other.config
+            && pixelFormat == other.pixelFormat && parent == other.parent;
+}
+
+QMirClientSurfacePool::QMirClientSurfacePool(EGLDisplay display, QMirClientSurfaceReaper *reaper)
+    : mEglDisplay(display)
+    , mReaper(reaper)
+    , mMaxSize(maxPoolSize())
+{
+    mClock.start();
+
+    mIdleTimer.setInterval(idleTimeoutMs / 2);
+    QObject::connect(&mIdleTimer, &QTimer::timeout, [this]() { releaseIdle(); });
+}
+
+QMirClientSurfacePool::~QMirClientSurfacePool()
+{
+    while (!mEntries.isEmpty()) {
+        release(mEntries.takeFirst());
+    }
+    qCDebug(mirclient, "~QMirClientSurfacePool - %llu surface(s) reused, %llu released unused",
+            mReuseCount, mReleaseCount);
+}
+
+bool QMirClientSurfacePool::isRecyclable(MirWindowType type)
+{
+    switch (type) {
+    case mir_window_type_menu:
+    case mir_window_type_tip:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void QMirClientSurfacePool::recycle(const Key &key, const Surface &surface)
+{
+    if (mMaxSize == 0) {
+        mReaper->reap(mEglDisplay, surface.eglSurface, surface.window, surface.context);
+        return;
+    }
+
+    if (mEntries.size() >= mMaxSize) {
+        release(mEntries.takeFirst());
+    }
+
+    qCDebug(mirclient, "QMirClientSurfacePool - recycling window=%p (%d pooled)", surface.window, mEntries.size() + 1);
+    mEntries.append(Entry{key, surface, mClock.elapsed()});
+    if (!mIdleTimer.isActive()) {
+        mIdleTimer.start();
+    }
+}
+
+bool QMirClientSurfacePool::take(const Key &key, Surface *surface)
+{
+    // Most recently recycled first, it is the least likely to be about to expire
+    for (int i = mEntries.size() - 1; i >= 0; --i) {
+        if (mEntries.at(i).key == key) {
+            *surface = mEntries.takeAt(i).surface;
+            ++mReuseCount;
+            qCDebug(mirclient, "QMirClientSurfacePool - reusing window=%p (%llu reused so far)", surface->window, mReuseCount);
+            return true;
+        }
+    }
+    return false;
+}
+
+void QMirClientSurfacePool::releaseChildrenOf(MirWindow *parent)
+{
+    QList<Entry> children;
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (it->key.parent == parent) {
+            children.append(*it);
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto &child : children) {
+        release(child);
+    }
+}
+
+// The entry must have been taken out of mEntries already
+void QMirClientSurfacePool::release(const Entry &entry)
+{
+    // A pooled menu may itself be the parent of pooled submenus
+    releaseChildrenOf(entry.surface.window);
+
+    ++mReleaseCount;
+    mReaper->reap(mEglDisplay, entry.surface.eglSurface, entry.surface.window, entry.surface.context);
+}
+
+void QMirClientSurfacePool::releaseIdle()
+{
+    const qint64 now = mClock.elapsed();
+    while (!mEntries.isEmpty() && now - mEntries.first().recycledAt >= idleTimeoutMs) {
+        qCDebug(mirclient, "QMirClientSurfacePool - releasing idle window=%p", mEntries.first().surface.window);
+        release(mEntries.takeFirst());
+    }
+
+    if (mEntries.isEmpty()) {
+        mIdleTimer.stop();
+    }
+}
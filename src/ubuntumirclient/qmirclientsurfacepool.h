@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QMIRCLIENTSURFACEPOOL_H
+#define QMIRCLIENTSURFACEPOOL_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+
+#include <mir_toolkit/mir_window.h>
+
+#include <EGL/egl.h>
+
+#include <memory>
+
+class QMirClientSurfaceReaper;
+
+class QMirClientSurfacePool
+{
+public:
+    struct Key
+    {
+        MirWindowType type;
+        EGLConfig config;
+        MirPixelFormat pixelFormat;
+        MirWindow *parent;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct Surface
+    {
+        MirWindow *window;
+        EGLSurface eglSurface;
+        std::shared_ptr<void> context; // what the window's event handler refers to
+    };
+
+    QMirClientSurfacePool(EGLDisplay display, QMirClientSurfaceReaper *reaper);
+    ~QMirClientSurfacePool();
+
+    // Only short-lived window types are worth recycling
+    static bool isRecyclable(MirWindowType type);
+
+    // GUI thread only. Hands a hidden surface over to the pool, which may release the least
+    // recently used surface to make room.
+    void recycle(const Key &key, const Surface &surface);
+
+    // GUI thread only. Returns false if there is no matching surface.
+    bool take(const Key &key, Surface *surface);
+
+    // Children can't outlive their parent, this releases the ones pooled for it
+    void releaseChildrenOf(MirWindow *parent);
+
+private:
+    struct Entry
+    {
+        Key key;
+        Surface surface;
+        qint64 recycledAt;
+    };
+
+    void release(const Entry &entry);
+    void releaseIdle();
+
+    const EGLDisplay mEglDisplay;
+    QMirClientSurfaceReaper * const mReaper;
+    const int mMaxSize;
+
+    QList<Entry> mEntries; // least recently recycled first
+    QElapsedTimer mClock;
+    QTimer mIdleTimer;
+    quint64 mReuseCount{0};
+    quint64 mReleaseCount{0};
+};
+
+#endif // QMIRCLIENTSURFACEPOOL_H
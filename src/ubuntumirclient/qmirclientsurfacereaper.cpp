@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#include "qmirclientsurfacereaper.h"
+#include "qmirclientlogging.h"
+
+#include <QMutexLocker>
+
+#include <mir_toolkit/mir_client_library.h>
+
+/*
+ * QMirClientSurfaceReaper - releases EGL surfaces and Mir windows away from the GUI thread.
+ *
+ * Releasing a MirWindow is a round trip to the server, which made closing popups and dialogs
+ * stall the GUI thread. Items are processed in the order they were handed over, and for each
+ * one the EGL surface is destroyed before the MirWindow backing its native window is released.
+ *
+ * Qt only releases the GUI thread's context when a window is destroyed. Rendering threads are
+ * expected to have stopped using the window's surface by then, as QtQuick's render loops do, but
+ * nothing enforces it. A surface still current elsewhere is only marked for destruction by EGL,
+ * which is as far as this goes too: the only ordering honoured is EGL surface first, Mir window
+ * second.
+ */
+
+QMirClientSurfaceReaper::QMirClientSurfaceReaper()
+{
+    setObjectName(QStringLiteral("QMirClientSurfaceReaper"));
+    start(QThread::LowPriority);
+}
+
+QMirClientSurfaceReaper::~QMirClientSurfaceReaper()
+{
+    {
+        QMutexLocker lock(&mMutex);
+        mQuit = true;
+        mQueueChanged.wakeAll();
+    }
+    // The queue is drained before the thread finishes
+    wait();
+}
+
+void QMirClientSurfaceReaper::reap(EGLDisplay display, EGLSurface eglSurface, MirWindow *window,
+                                   const std::shared_ptr<void> &context)
+{
+    if (eglSurface == EGL_NO_SURFACE && !window) {
+        return;
+    }
+
+    QMutexLocker lock(&mMutex);
+    mQueue.enqueue(Item{display, eglSurface, window, context});
+    mQueueChanged.wakeAll();
+}
+
+void QMirClientSurfaceReaper::run()
+{
+    QMutexLocker lock(&mMutex);
+    Q_FOREVER {
+        while (mQueue.isEmpty() && !mQuit) {
+            mQueueChanged.wait(&mMutex);
+        }
+        if (mQueue.isEmpty()) {
+            break;
+        }
+
+        Item item = mQueue.dequeue();
+        lock.unlock();
+
+        qCDebug(mirclient, "QMirClientSurfaceReaper - releasing eglSurface=%p, window=%p", item.eglSurface, item.window);
+        if (item.eglSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(item.display, item.eglSurface);
+        }
+        if (item.window) {
+            mir_window_release_sync(item.window);
+        }
+        item.context.reset();
+
+        lock.relock();
+    }
+    lock.unlock();
+
+    eglReleaseThread();
+}
@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QMIRCLIENTSURFACEREAPER_H
+#define QMIRCLIENTSURFACEREAPER_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <mir_toolkit/mir_window.h>
+
+#include <EGL/egl.h>
+
+#include <memory>
+
+class QMirClientSurfaceReaper : public QThread
+{
+public:
+    QMirClientSurfaceReaper();
+    ~QMirClientSurfaceReaper();
+
+    // Takes ownership of the given EGL surface and MirWindow (either may be null) and destroys them
+    // in that order on the reaper thread, so the caller does not wait for the server.
+    // The context, if any, is kept alive until the window is gone; it is for whatever the
+    // window's callbacks refer to.
+    void reap(EGLDisplay display, EGLSurface eglSurface, MirWindow *window,
+              const std::shared_ptr<void> &context = {});
+
+protected:
+    void run() override;
+
+private:
+    struct Item
+    {
+        EGLDisplay display;
+        EGLSurface eglSurface;
+        MirWindow *window;
+        std::shared_ptr<void> context;
+    };
+
+    QMutex mMutex;
+    QWaitCondition mQueueChanged;
+    QQueue<Item> mQueue;
+    bool mQuit{false};
+};
+
+#endif // QMIRCLIENTSURFACEREAPER_H
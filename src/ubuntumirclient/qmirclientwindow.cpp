@@ -41,10 +41,15 @@
 // Local
 #include "qmirclientwindow.h"
 #include "qmirclientdebugextension.h"
+#include "qmirclienteglconfigcache.h"
 #include "qmirclientnativeinterface.h"
 #include "qmirclientinput.h"
 #include "qmirclientintegration.h"
 #include "qmirclientscreen.h"
+#include "qmirclientspeculativewindow.h"
+#include "qmirclientsurfacepool.h"
+#include "qmirclientsurfacereaper.h"
+#include "qmirclientwindowregistry.h"
 #include "qmirclientlogging.h"
 
 #include <mir_toolkit/mir_client_library.h>
@@ -52,16 +57,31 @@
 
 // Qt
 #include <qpa/qwindowsysteminterface.h>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
 #include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
 #include <QSize>
 #include <QtMath>
 #include <QtGui/private/qguiapplication_p.h>
+#include <QtGui/private/qwindow_p.h>
 #include <QtPlatformSupport/private/qeglconvenience_p.h>
 
 #include <EGL/egl.h>
 
+#include <time.h>
+#include <vector>
+
+// From EGL_EXT_buffer_age, which older headers lack
+#ifndef EGL_BUFFER_AGE_EXT
+#define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
 Q_LOGGING_CATEGORY(mirclientBufferSwap, "qt.qpa.mirclient.bufferSwap", QtWarningMsg)
 
+class UbuntuSurface;
+
 namespace
 {
 const Qt::WindowType InputMethodWindowType = (Qt::WindowType)(0x00000080 | Qt::WindowType::Window); // Qt has no such thing
@@ -75,6 +95,24 @@ struct MirSpecDeleter
 
 using Spec = std::unique_ptr<MirWindowSpec, MirSpecDeleter>;
 
+// Shared between a surface and the Mir thread answering its persistent id request,
+// as the answer may arrive after the surface is gone.
+struct PersistentIdRequest
+{
+    QMutex mutex;
+    QString id;
+    QMirClientWindow *platformWindow{nullptr};
+};
+
+// Context of a MirWindow's event handler. Mir calls the handler until the window is released,
+// which may be well after the surface that created it is gone (see QMirClientSurfaceReaper),
+// and a recycled window is adopted by another surface (see QMirClientSurfacePool).
+struct EventSink
+{
+    QMutex mutex;
+    UbuntuSurface *surface{nullptr};
+};
+
 EGLNativeWindowType nativeWindowFor(MirWindow *surf)
 {
     auto stream = mir_window_get_buffer_stream(surf);
@@ -189,12 +227,6 @@ MirWindowType qtWindowTypeToMirWindowType(Qt::WindowType type)
     }
 }
 
-WId makeId()
-{
-    static int id = 1;
-    return id++;
-}
-
 QMirClientWindow *transientParentFor(QWindow *window)
 {
     QWindow *parent = window->transientParent();
@@ -308,7 +340,109 @@ void setSizingConstraints(MirWindowSpec *spec, const QSize& minSize, const QSize
     }
 }
 
-void setMask(MirWindowSpec *spec, const QRegion& mask)
+const int defaultMaskRectThreshold = 32;
+const qreal defaultMaskErrorBudget = 0.1;
+
+int maskRectThresholdFromEnvironment()
+{
+    if (!qEnvironmentVariableIsSet("QTUBUNTU_MASK_RECT_THRESHOLD")) {
+        return defaultMaskRectThreshold;
+    }
+
+    bool ok;
+    const int threshold = qgetenv("QTUBUNTU_MASK_RECT_THRESHOLD").toInt(&ok);
+    if (!ok || threshold <= 0) {
+        qCWarning(mirclient, "Invalid QTUBUNTU_MASK_RECT_THRESHOLD, using %d", defaultMaskRectThreshold);
+        return defaultMaskRectThreshold;
+    }
+    return threshold;
+}
+
+// Masks made of more rectangles than this are simplified before being sent to Mir
+int maskRectThreshold()
+{
+    static const int threshold = maskRectThresholdFromEnvironment();
+    return threshold;
+}
+
+qreal maskErrorBudgetFromEnvironment()
+{
+    if (!qEnvironmentVariableIsSet("QTUBUNTU_MASK_ERROR_BUDGET")) {
+        return defaultMaskErrorBudget;
+    }
+
+    bool ok;
+    const qreal budget = qgetenv("QTUBUNTU_MASK_ERROR_BUDGET").toDouble(&ok);
+    if (!ok || budget < 0 || budget > 1) {
+        qCWarning(mirclient, "Invalid QTUBUNTU_MASK_ERROR_BUDGET, using %.2f", defaultMaskErrorBudget);
+        return defaultMaskErrorBudget;
+    }
+    return budget;
+}
+
+// Area a simplified mask may add, as a fraction of the area of the original mask
+qreal maskErrorBudget()
+{
+    static const qreal budget = maskErrorBudgetFromEnvironment();
+    return budget;
+}
+
+qint64 area(const QRect &rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+MirRectangle mirRectangle(const QRect &rect)
+{
+    return MirRectangle{rect.x(), rect.y(), (unsigned int) rect.width(), (unsigned int) rect.height()};
+}
+
+/*
+    Simplified masks always contain the original one, they only ever accept more input.
+    Neighbouring rectangles (QRegion keeps them sorted by band, then left to right) are merged
+    into their bounding rectangle for as long as the area this adds fits in the error budget.
+    Should that not bring the count below the threshold, the bounding box of the mask is used.
+    Rectangles are merged in place, the caller's storage is all this needs.
+ */
+void simplifyMask(const QRegion &mask, std::vector<MirRectangle> &rects)
+{
+    rects.clear();
+
+    const QVector<QRect> maskRects = mask.rects();
+    qint64 maskArea = 0;
+    for (const auto &rect : maskRects) {
+        maskArea += area(rect);
+    }
+
+    qint64 budget = qint64(maskArea * maskErrorBudget());
+    for (const auto &rect : maskRects) {
+        if (!rects.empty()) {
+            const QRect last(rects.back().left, rects.back().top, rects.back().width, rects.back().height);
+            if (last.contains(rect)) {
+                // Already swallowed by an earlier merge
+                continue;
+            }
+            // Only what neither the merged rectangle nor the new one covers is added, the
+            // part of the new rectangle already inside the merged one must not count twice
+            const QRect united = last.united(rect);
+            const qint64 cost = area(united) - area(last) - area(rect) + area(last.intersected(rect));
+            if (cost <= budget) {
+                budget -= cost;
+                rects.back() = mirRectangle(united);
+                continue;
+            }
+        }
+        rects.push_back(mirRectangle(rect));
+    }
+
+    if (int(rects.size()) > maskRectThreshold()) {
+        rects.clear();
+        rects.push_back(mirRectangle(mask.boundingRect()));
+    }
+}
+
+// Mir copies the rectangles into the spec, so the same storage can be used for every mask
+void setMask(MirWindowSpec *spec, const QRegion& mask, std::vector<MirRectangle> &rects)
 {
     const int count = mask.rectCount();
     if (count == 0) {
@@ -316,24 +450,24 @@ void setMask(MirWindowSpec *spec, const QRegion& mask)
         return;
     }
 
-    // Convert the QRegion into a list of MirRectangles
-    auto rects = new MirRectangle[count];
-
-    int i=0;
-    for (const auto &rect : mask.rects()) {
-        rects[i].left   = rect.x();
-        rects[i].top    = rect.y();
-        rects[i].width  = (unsigned int) rect.width();
-        rects[i].height = (unsigned int) rect.height();
-        i++;
+    if (count > maskRectThreshold()) {
+        simplifyMask(mask, rects);
+        qCDebug(mirclient, "setMask - simplified mask from %d to %d rectangle(s)", count, int(rects.size()));
+    } else {
+        // Convert the QRegion into a list of MirRectangles
+        rects.clear();
+        for (const auto &rect : mask.rects()) {
+            rects.push_back(mirRectangle(rect));
+        }
     }
 
-    mir_window_spec_set_input_shape(spec, rects, count);
+    mir_window_spec_set_input_shape(spec, rects.data(), rects.size());
 }
 
-MirWindow *createMirWindow(QWindow *window, int mirOutputId, QMirClientWindow *parentWindowHandle,
-                             MirPixelFormat pixelFormat, MirConnection *connection,
-                             MirWindowEventCallback inputCallback, void *inputContext)
+Spec makeWindowSpec(QWindow *window, int mirOutputId, QMirClientWindow *parentWindowHandle,
+                    MirPixelFormat pixelFormat, MirConnection *connection,
+                    MirWindowEventCallback inputCallback, void *inputContext,
+                    std::vector<MirRectangle> &maskRects)
 {
     auto spec = makeSurfaceSpec(window, pixelFormat, parentWindowHandle, connection);
 
@@ -344,7 +478,7 @@ MirWindow *createMirWindow(QWindow *window, int mirOutputId, QMirClientWindow *p
     mir_window_spec_set_name(spec.get(), title.constData());
 
     setSizingConstraints(spec.get(), window->minimumSize(), window->maximumSize(), window->sizeIncrement());
-    setMask(spec.get(), window->mask());
+    setMask(spec.get(), window->mask(), maskRects);
 
     if (window->windowState() == Qt::WindowFullScreen) {
         mir_window_spec_set_fullscreen_on_output(spec.get(), mirOutputId);
@@ -358,9 +492,116 @@ MirWindow *createMirWindow(QWindow *window, int mirOutputId, QMirClientWindow *p
         mir_window_spec_set_state(spec.get(), mir_window_state_hidden);
     }
 
-    auto surface = mir_create_window_sync(spec.get());
-    Q_ASSERT(mir_window_is_valid(surface));
-    return surface;
+    return spec;
+}
+
+MirWindowState initialWindowState(QWindow *window)
+{
+    if (!window->isVisible()) {
+        return mir_window_state_hidden;
+    } else if (window->windowState() == Qt::WindowFullScreen) {
+        return mir_window_state_fullscreen;
+    } else {
+        return mir_window_state_restored;
+    }
+}
+
+bool asyncWindowCreation()
+{
+    static const bool async = qEnvironmentVariableIsSet("QTUBUNTU_ASYNC_WINDOW_CREATION");
+    return async;
+}
+
+// Negative when not set: no throttling. 0 pauses rendering altogether.
+qreal throttledFrameRate(const char *variable)
+{
+    return qEnvironmentVariableIsSet(variable) ? qgetenv(variable).toDouble() : -1;
+}
+
+qreal unfocusedFrameRate()
+{
+    static const qreal frameRate = throttledFrameRate("QTUBUNTU_UNFOCUSED_FRAME_RATE");
+    return frameRate;
+}
+
+qreal occludedFrameRate()
+{
+    static const qreal frameRate = throttledFrameRate("QTUBUNTU_OCCLUDED_FRAME_RATE");
+    return frameRate;
+}
+
+// How long a window stays hidden or minimized before its buffers are released, negative to keep them
+int releaseHiddenBuffersTimeout()
+{
+    static const int timeout = qEnvironmentVariableIsSet("QTUBUNTU_RELEASE_HIDDEN_BUFFERS_TIMEOUT")
+            ? qgetenv("QTUBUNTU_RELEASE_HIDDEN_BUFFERS_TIMEOUT").toInt() : -1;
+    return timeout;
+}
+
+// Same clock as the timestamps of Mir input events
+qint64 monotonicTimeNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Windows asking for a single buffer want their frames on screen as soon as possible
+QMirClientWindow::BufferingMode bufferingModeFor(QSurfaceFormat::SwapBehavior swapBehavior)
+{
+    return swapBehavior == QSurfaceFormat::SingleBuffer
+            ? QMirClientWindow::BufferingMode::LowLatency : QMirClientWindow::BufferingMode::Default;
+}
+
+// The swap interval QEGLPlatformContext applies when nothing else sets one
+int defaultSwapInterval(const QSurfaceFormat &format)
+{
+    bool ok = false;
+    const int interval = qEnvironmentVariableIntValue("QT_QPA_EGLFS_SWAPINTERVAL", &ok);
+    return ok ? interval : format.swapInterval();
+}
+
+// Render scales are fractions of the window size, larger ones make no sense. Returns 0 if unset or invalid.
+float renderScaleFromEnvironment(const char *variable)
+{
+    bool ok = false;
+    const float scale = qgetenv(variable).toFloat(&ok);
+    return ok && scale > 0 ? qMin(scale, 1.0f) : 0;
+}
+
+// Only raster windows get QTUBUNTU_RENDER_SCALE, the backing store sets their viewport. OpenGL clients
+// set their own from the window size and device pixel ratio, they opt in through "renderScale".
+float defaultRenderScale(const QWindow *window)
+{
+    static const float scale = qEnvironmentVariableIsSet("QTUBUNTU_RENDER_SCALE")
+            ? renderScaleFromEnvironment("QTUBUNTU_RENDER_SCALE") : 0;
+    return scale > 0 && window->surfaceType() == QSurface::RasterSurface ? scale : 1;
+}
+
+// Lowest render scale the adaptive mode may go down to, 0 when it is disabled
+float adaptiveRenderScaleMinimum()
+{
+    static const float scale = qEnvironmentVariableIsSet("QTUBUNTU_ADAPTIVE_RENDER_SCALE")
+            ? renderScaleFromEnvironment("QTUBUNTU_ADAPTIVE_RENDER_SCALE") : 0;
+    return scale;
+}
+
+// Size of the buffers of a window of the given size rendered at the given scale
+QSize scaledSize(const QSize &size, float scale)
+{
+    if (scale == 1) {
+        return size;
+    }
+    return QSize(qMax(1, qRound(size.width() * scale)), qMax(1, qRound(size.height() * scale)));
+}
+
+// Mir and us may round differently, allow for that when the buffers are scaled
+bool bufferSizeMatches(const QSize &bufferSize, const QSize &windowSize, float scale)
+{
+    const QSize expected = scaledSize(windowSize, scale);
+    const int tolerance = scale == 1 ? 0 : 1;
+    return qAbs(bufferSize.width() - expected.width()) <= tolerance
+            && qAbs(bufferSize.height() - expected.height()) <= tolerance;
 }
 
 QMirClientWindow *getParentIfNecessary(QWindow *window, QMirClientInput *input)
@@ -377,18 +618,6 @@ QMirClientWindow *getParentIfNecessary(QWindow *window, QMirClientInput *input)
     return parentWindowHandle;
 }
 
-MirPixelFormat disableAlphaBufferIfPossible(MirPixelFormat pixelFormat)
-{
-    switch (pixelFormat) {
-    case mir_pixel_format_abgr_8888:
-        return mir_pixel_format_xbgr_8888;
-    case mir_pixel_format_argb_8888:
-        return mir_pixel_format_xrgb_8888;
-    default: // can do nothing, leave it alone
-        return pixelFormat;
-    }
-}
-
 // FIXME - in order to work around https://bugs.launchpad.net/mir/+bug/1346633
 // we need to guess the panel height (3GU)
 int panelHeight()
@@ -419,37 +648,83 @@ public:
     UbuntuSurface(const UbuntuSurface &) = delete;
     UbuntuSurface& operator=(const UbuntuSurface &) = delete;
 
+    // Creates or adopts the Mir window. Separate from the constructor as it calls back into the
+    // platform window, which must be fully constructed by then.
+    void create();
+
     void updateGeometry(const QRect &newGeometry);
     void updateTitle(const QString& title);
     void setSizingConstraints(const QSize& minSize, const QSize& maxSize, const QSize& increment);
     void setMask(const QRegion &mask);
 
-    void onSwapBuffersDone();
-    void handleSurfaceResized(int width, int height);
-    int needsRepaint() const;
+    bool onSwapBuffersDone();
+    QSize takePendingResize();
+    bool needsRepaint();
 
-    MirWindowState state() const { return mir_window_get_state(mMirWindow); }
+    MirWindowState state() const { return mState; }
     void setState(MirWindowState state);
 
     MirWindowType type() const { return mir_window_get_type(mMirWindow); }
 
+    // With asynchronous creation the MirWindow only exists once the server has replied
+    bool isPending() const { return mMirWindow == nullptr; }
+    void waitForCreation();
+    bool completeCreation();
+
     void setShellChrome(MirShellChrome shellChrome);
 
+    void applyPendingSpec();
+
     EGLSurface eglSurface() const { return mEglSurface; }
     MirWindow *mirWindow() const { return mMirWindow; }
 
     void setSurfaceParent(MirWindow*);
     bool hasParent() const { return mParented; }
 
-    QSurfaceFormat format() const { return mFormat; }
+    static QMirClientSurfacePool::Surface createSpeculative(MirConnection *connection, EGLDisplay display,
+                                                            QMirClientEglConfigCache *configCache,
+                                                            const QSize &size, QMirClientSurfacePool::Key *key);
 
-    bool mNeedsExposeCatchup;
+    QSurfaceFormat format() const;
 
-    QString persistentSurfaceId();
+    // -1 keeps the swap interval of the requested format
+    void setSwapInterval(int interval) { mSwapInterval.store(interval); }
+    void syncSwapInterval();
+
+    // For hidden windows: destroy the EGL surface and reallocate the buffer stream at 1x1, then
+    // bring both back. Both return whether they did anything.
+    bool releaseBuffers();
+    bool restoreBuffers();
+
+    // Rendering thread, around the window's EGL surface being current, see restoreBuffers()
+    void aboutToMakeCurrent();
+    void doneCurrent();
+
+    int bufferAge() const;
+
+    // Fraction of the window size the buffers are allocated at, the compositor scales them back up
+    float renderScale() const;
+    void setRenderScale(float scale);
+
+    bool mNeedsExposeCatchup{false}; // guarded by QMirClientWindow::mMutex, read on swap
+
+    // The id is requested as soon as the MirWindow exists, the platform window is notified
+    // through onPersistentSurfaceIdReady() once it arrives
+    QString persistentSurfaceId() const;
 
 private:
     static void surfaceEventCallback(MirWindow* surface, const MirEvent *event, void* context);
+    static void windowCreatedCallback(MirWindow* window, void* context);
+    static void persistentIdCallback(MirWindow* window, MirWindowId* id, void* context);
+    void requestPersistentSurfaceId();
     void postEvent(const MirEvent *event);
+    void initializeMirWindow(MirWindow *window, EGLSurface eglSurface = EGL_NO_SURFACE);
+    void setEglSurface(EGLSurface eglSurface);
+    void adoptRecycledWindow(const QMirClientSurfacePool::Surface &recycled);
+    void sendGeometry(const QRect &geometry, qint64 requestedAt);
+    void releaseGeometryFrame();
+    void confirmGeometry(const QSize &size);
+    MirWindowSpec *pendingSpec();
 
     QWindow * const mWindow;
     QMirClientWindow * const mPlatformWindow;
@@ -457,20 +732,72 @@ private:
     MirConnection * const mConnection;
     QMirClientWindow * mParentWindowHandle{nullptr};
 
-    MirWindow* mMirWindow;
+    MirWindow* mMirWindow{nullptr};
     const EGLDisplay mEglDisplay;
-    EGLSurface mEglSurface;
+    EGLSurface mEglSurface{EGL_NO_SURFACE};
+    // Set by the rendering thread before it fetches the EGL surface to make it current, and only
+    // cleared once it no longer uses it. Both guarded by QMirClientWindow::mMutex.
+    bool mEglSurfaceCurrent{false};
+    bool mEglSurfaceReleasePending{false};
+    EGLConfig mConfig;
+
+    MirWaitHandle *mCreationHandle{nullptr};
+    QAtomicPointer<MirWindow> mCreatedWindow;
+    // mir_window_get_state() only changes once the server confirms a request, and not at all for
+    // state asked of a recycled window by its previous user, so track what was asked for instead.
+    // mAppliedState is what Mir was last told, they differ while the window is pending.
+    MirWindowState mState;
+    MirWindowState mAppliedState;
 
-    bool mNeedsRepaint;
     bool mParented;
-    QSize mBufferSize;
+    QRegion mMask;
+    std::vector<MirRectangle> mMaskRects;
+    QSize mBufferSize; // guarded by mTargetSizeMutex, the rendering thread updates it on swap
     QSurfaceFormat mFormat;
     MirPixelFormat mPixelFormat;
 
-    QMutex mTargetSizeMutex;
+    // Set from the GUI thread, applied to the EGL surface from the rendering thread. The GUI thread
+    // resets the applied one to -1 when it destroys the EGL surface, see syncSwapInterval().
+    QAtomicInt mSwapInterval{-1};
+    QAtomicInt mAppliedSwapInterval{-1};
+
+    // Latest size Mir asked for, written from the Mir event thread. Only one resize event per
+    // window is in the Qt event queue at any time, it is handled using whatever size is latest.
+    mutable QMutex mTargetSizeMutex;
     QSize mTargetSize;
+    float mRenderScale{defaultRenderScale(mWindow)}; // also guarded by mTargetSizeMutex
+    bool mResizePending{false};
+    quint64 mCoalescedResizeCount{0};
+
+    // A resize is rendered once. Only if that frame went into a buffer of the old size (the client
+    // may hold one when the resize arrives) is another one needed, which the swap tells us.
+    bool mNeedsRepaint{false};
+    int mResizeRenders{0};
     MirShellChrome mShellChrome;
-    QString mPersistentIdStr;
+    std::shared_ptr<PersistentIdRequest> mPersistentId;
+    std::shared_ptr<EventSink> mEventSink;
+    QMirClientSurfacePool::Key mPoolKey;
+
+    // At most one geometry change is sent per window per frame, requests made in the meantime
+    // replace each other and the latest is sent once the frame is over or Mir has answered.
+    QTimer mGeometryFrameTimer;
+    QElapsedTimer mGeometryClock;
+    bool mGeometryInFlight{false};
+    bool mGeometryQueued{false};
+    QRect mQueuedGeometry;
+    qint64 mQueuedAt{0};
+    QSize mAwaitedSize;
+    qint64 mAwaitedSince{-1};
+    quint64 mReplacedGeometryRequests{0};
+    quint64 mConfirmedGeometryRequests{0};
+    QSize mSize; // as last reported by Mir, what geometry requests are compared with
+    qint64 mTotalGeometryLatency{0};
+
+    // Changes requested during one event loop iteration are merged into a single spec
+    Spec mPendingSpec;
+    int mPendingSpecChanges{0};
+    quint64 mAppliedSpecCount{0};
+    quint64 mMergedSpecCount{0};
 };
 
 UbuntuSurface::UbuntuSurface(QMirClientWindow *platformWindow, EGLDisplay display, QMirClientInput *input, MirConnection *connection)
@@ -479,223 +806,683 @@ UbuntuSurface::UbuntuSurface(QMirClientWindow *platformWindow, EGLDisplay displa
     , mInput(input)
     , mConnection(connection)
     , mEglDisplay(display)
-    , mNeedsRepaint(false)
+    , mState(initialWindowState(mWindow))
+    , mAppliedState(mState)
     , mParented(mWindow->transientParent() || mWindow->parent())
+    , mMask(mWindow->mask())
     , mFormat(mWindow->requestedFormat())
     , mShellChrome(mWindow->flags() & LowChromeWindowHint ? mir_shell_chrome_low : mir_shell_chrome_normal)
 {
-    // Have Qt choose most suitable EGLConfig for the requested surface format, and update format to reflect it
-    EGLConfig config = q_configFromGLFormat(display, mFormat, true);
-    if (config == 0) {
-        // Older Intel Atom-based devices only support OpenGL 1.4 compatibility profile but by default
-        // QML asks for at least OpenGL 2.0. The XCB GLX backend ignores this request and returns a
-        // 1.4 context, but the XCB EGL backend tries to honor it, and fails. The 1.4 context appears to
-        // have sufficient capabilities on MESA (i915) to render correctly however. So reduce the default
-        // requested OpenGL version to 1.0 to ensure EGL will give us a working context (lp:1549455).
-        static const bool isMesa = QString(eglQueryString(display, EGL_VENDOR)).contains(QStringLiteral("Mesa"));
-        if (isMesa) {
-            qCDebug(mirclientGraphics, "Attempting to choose OpenGL 1.4 context which may suit Mesa");
-            mFormat.setMajorVersion(1);
-            mFormat.setMinorVersion(4);
-            config = q_configFromGLFormat(display, mFormat, true);
+    mGeometryClock.start();
+    mGeometryFrameTimer.setSingleShot(true);
+    QObject::connect(&mGeometryFrameTimer, &QTimer::timeout, [this]() { releaseGeometryFrame(); });
+
+    // Choosing an EGLConfig is costly, windows share the result with other windows and contexts
+    // requesting the same format
+    const auto surfaceConfig = input->integration()->eglConfigCache()->configForFormat(mFormat);
+    mConfig = surfaceConfig.config;
+    mFormat = surfaceConfig.format;
+    mPixelFormat = surfaceConfig.pixelFormat;
+
+    qCDebug(mirclientGraphics)
+                       << "Requested format:" << mWindow->requestedFormat()
+                       << "\nActual format:" << mFormat
+                       << "with associated Mir pixel format:" << mirPixelFormatToStr(mPixelFormat);
+}
+
+void UbuntuSurface::create()
+{
+    const auto outputId = static_cast<QMirClientScreen *>(mWindow->screen()->handle())->mirOutputId();
+
+    mParentWindowHandle = getParentIfNecessary(mWindow, mInput);
+    if (mParentWindowHandle) {
+        // Mir needs the parent's MirWindow in the spec, so it must have been created by now
+        mParentWindowHandle->waitForMirWindow();
+    }
+
+    mPoolKey = QMirClientSurfacePool::Key{qtWindowTypeToMirWindowType(mWindow->type()), mConfig, mPixelFormat,
+                                          mParentWindowHandle ? mParentWindowHandle->mirWindow() : nullptr};
+
+    QMirClientSurfacePool::Surface recycled;
+    auto speculativeWindow = mInput->integration()->speculativeWindow();
+    if (QMirClientSurfacePool::isRecyclable(mPoolKey.type)
+            && mInput->integration()->surfacePool()->take(mPoolKey, &recycled)) {
+        adoptRecycledWindow(recycled);
+    } else if (mPoolKey.type == mir_window_type_normal && !mParented && speculativeWindow
+               && speculativeWindow->take(mPoolKey, &recycled)) {
+        adoptRecycledWindow(recycled);
+    } else {
+        mEventSink = std::make_shared<EventSink>();
+        mEventSink->surface = this;
+
+        auto spec = makeWindowSpec(mWindow, outputId, mParentWindowHandle, mPixelFormat, mConnection,
+                                   surfaceEventCallback, mEventSink.get(), mMaskRects);
+
+        if (asyncWindowCreation()) {
+            qCDebug(mirclient, "UbuntuSurface(window=%p) - creating Mir window asynchronously", mWindow);
+            mCreationHandle = mir_create_window(spec.get(), windowCreatedCallback, this);
+        } else {
+            initializeMirWindow(mir_create_window_sync(spec.get()));
         }
     }
-    if (config == 0) {
-        qCritical() << "Qt failed to choose a suitable EGLConfig to suit the surface format" << mFormat;
+}
+
+UbuntuSurface::~UbuntuSurface()
+{
+    if (mCreationHandle && isPending()) {
+        // Cannot leave the callback with a dangling context, nor leak the window it delivers
+        mir_wait_for(mCreationHandle);
+        mMirWindow = mCreatedWindow.fetchAndStoreOrdered(nullptr);
     }
 
-    mFormat = q_glFormatFromConfig(display, config, mFormat);
+    if (mPersistentId) {
+        QMutexLocker lock(&mPersistentId->mutex);
+        mPersistentId->platformWindow = nullptr;
+    }
 
-    // Have Mir decide the pixel format most suited to the chosen EGLConfig. This is the only way
-    // Mir will know what EGLConfig has been chosen - it cannot deduce it from the buffers.
-    mPixelFormat = mir_connection_get_egl_pixel_format(connection, display, config);
-    // But the chosen EGLConfig might have an alpha buffer enabled, even if not requested by the client.
-    // If that's the case, try to edit the chosen pixel format in order to disable the alpha buffer.
-    // This is an optimization for the compositor, as it can avoid blending this surface.
-    if (mWindow->requestedFormat().alphaBufferSize() < 0) {
-        mPixelFormat = disableAlphaBufferIfPossible(mPixelFormat);
+    {
+        QMutexLocker lock(&mEventSink->mutex);
+        mEventSink->surface = nullptr;
     }
 
-    const auto outputId = static_cast<QMirClientScreen *>(mWindow->screen()->handle())->mirOutputId();
+    auto pool = mInput->integration()->surfacePool();
+    if (mMirWindow) {
+        pool->releaseChildrenOf(mMirWindow);
+    }
+
+    if (QMirClientSurfacePool::isRecyclable(mPoolKey.type) && mMirWindow && mir_window_is_valid(mMirWindow)
+            && mEglSurface != EGL_NO_SURFACE) {
+        if (mAppliedState != mir_window_state_hidden) {
+            mir_window_set_state(mMirWindow, mir_window_state_hidden);
+        }
+        pool->recycle(mPoolKey, QMirClientSurfacePool::Surface{mMirWindow, mEglSurface, mEventSink});
+    } else {
+        // Releasing the window is a server round trip, don't make the GUI thread wait for it
+        mInput->integration()->surfaceReaper()->reap(mEglDisplay, mEglSurface, mMirWindow, mEventSink);
+    }
+}
+
+void UbuntuSurface::windowCreatedCallback(MirWindow *window, void *context)
+{
+    Q_ASSERT(context != nullptr);
+
+    // Called on a Mir thread, finish the job on the GUI thread
+    auto s = static_cast<UbuntuSurface *>(context);
+    s->mCreatedWindow.storeRelease(window);
+    QMetaObject::invokeMethod(s->mPlatformWindow, "onMirWindowCreated", Qt::QueuedConnection);
+}
+
+void UbuntuSurface::waitForCreation()
+{
+    if (mCreationHandle && isPending()) {
+        qCDebug(mirclient, "waitForCreation(window=%p)", mWindow);
+        mir_wait_for(mCreationHandle);
+    }
+}
 
-    mParentWindowHandle = getParentIfNecessary(mWindow, input);
+bool UbuntuSurface::completeCreation()
+{
+    MirWindow *window = mCreatedWindow.fetchAndStoreOrdered(nullptr);
+    if (!window) {
+        return false;
+    }
+
+    mCreationHandle = nullptr;
+    initializeMirWindow(window);
+
+    // Replay whatever the application asked for while the window was being created
+    applyPendingSpec();
+    if (mState != mAppliedState) {
+        mir_window_set_state(mMirWindow, mState);
+        mAppliedState = mState;
+    }
+    return true;
+}
+
+void UbuntuSurface::initializeMirWindow(MirWindow *window, EGLSurface eglSurface)
+{
+    mMirWindow = window;
+    Q_ASSERT(mir_window_is_valid(mMirWindow));
+    if (!mir_window_is_valid(mMirWindow)) {
+        qCritical() << "Mir failed to create a window:" << mir_window_get_error_message(mMirWindow);
+    }
+
+    // Recycled windows may have been scaled differently
+    const float renderScale = this->renderScale();
+    if (renderScale != 1 || eglSurface != EGL_NO_SURFACE) {
+        mir_buffer_stream_set_scale(mir_window_get_buffer_stream(mMirWindow), renderScale);
+    }
 
-    mMirWindow = createMirWindow(mWindow, outputId, mParentWindowHandle, mPixelFormat, connection, surfaceEventCallback, this);
-    mEglSurface = eglCreateWindowSurface(mEglDisplay, config, nativeWindowFor(mMirWindow), nullptr);
+    setEglSurface(eglSurface != EGL_NO_SURFACE
+                  ? eglSurface : eglCreateWindowSurface(mEglDisplay, mConfig, nativeWindowFor(mMirWindow), nullptr));
 
-    mNeedsExposeCatchup = mir_window_get_visibility(mMirWindow) == mir_window_visibility_occluded;
+    const bool occluded = mir_window_get_visibility(mMirWindow) == mir_window_visibility_occluded;
+    {
+        QMutexLocker lock(&mPlatformWindow->mMutex);
+        mNeedsExposeCatchup = occluded;
+    }
 
-    // Window manager can give us a final size different from what we asked for
-    // so let's check what we ended up getting
-    MirWindowParameters parameters;
-    mir_window_get_parameters(mMirWindow, &parameters);
+    requestPersistentSurfaceId();
 
     auto geom = mWindow->geometry();
-    geom.setWidth(parameters.width);
-    geom.setHeight(parameters.height);
+    if (eglSurface == EGL_NO_SURFACE) {
+        // Window manager can give us a final size different from what we asked for
+        // so let's check what we ended up getting
+        MirWindowParameters parameters;
+        mir_window_get_parameters(mMirWindow, &parameters);
+        geom.setWidth(parameters.width);
+        geom.setHeight(parameters.height);
+    }
 
-    // Assume that the buffer size matches the surface size at creation time
-    mBufferSize = geom.size();
-    platformWindow->QPlatformWindow::setGeometry(geom);
+    // Assume that the buffer size matches the (scaled) surface size at creation time
+    mSize = geom.size();
+    const QSize bufferSize = scaledSize(geom.size(), renderScale);
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        mBufferSize = bufferSize;
+    }
+    if (eglSurface != EGL_NO_SURFACE) {
+        // A recycled or speculative window still has its old size, which the window is about to
+        // ask Mir to change; reporting the old size first would cost the window an extra resize
+        mir_buffer_stream_set_size(mir_window_get_buffer_stream(mMirWindow), bufferSize.width(), bufferSize.height());
+    }
+    mPlatformWindow->updatePlatformGeometry(geom);
     QWindowSystemInterface::handleGeometryChange(mWindow, geom);
 
     qCDebug(mirclient) << "Created surface with geometry:" << geom << "title:" << mWindow->title();
-    qCDebug(mirclientGraphics)
-                       << "Requested format:" << mWindow->requestedFormat()
-                       << "\nActual format:" << mFormat
-                       << "with associated Mir pixel format:" << mirPixelFormatToStr(mPixelFormat);
 }
 
-UbuntuSurface::~UbuntuSurface()
+// The rendering thread reads the EGL surface through QMirClientWindow::eglSurface()
+void UbuntuSurface::setEglSurface(EGLSurface eglSurface)
 {
-    if (mEglSurface != EGL_NO_SURFACE)
-        eglDestroySurface(mEglDisplay, mEglSurface);
-    if (mMirWindow) {
-        mir_window_release_sync(mMirWindow);
-    }
+    QMutexLocker lock(&mPlatformWindow->mMutex);
+    mEglSurface = eglSurface;
 }
 
-void UbuntuSurface::updateGeometry(const QRect &newGeometry)
+bool UbuntuSurface::releaseBuffers()
 {
+    if (isPending() || mEglSurface == EGL_NO_SURFACE) {
+        return false;
+    }
 
-    auto spec = Spec{mir_create_window_spec(mConnection)};
-
-    mir_window_spec_set_width(spec.get(), newGeometry.width());
-    mir_window_spec_set_height(spec.get(), newGeometry.height());
+    // A rendering thread may have fetched the surface to make it current, or be rendering to it.
+    // It is only destroyed once that thread is done with it, which then has the GUI thread try
+    // again, see doneCurrent(). Taking it away under the same lock the rendering thread fetches it
+    // with means that thread gets EGL_NO_SURFACE from then on.
+    const EGLSurface eglSurface = mEglSurface;
+    {
+        QMutexLocker lock(&mPlatformWindow->mMutex);
+        if (mEglSurfaceCurrent) {
+            qCDebug(mirclientGraphics, "releaseBuffers(window=%p) - surface in use, waiting for the rendering thread",
+                    mWindow);
+            mEglSurfaceReleasePending = true;
+            return false;
+        }
+        mEglSurface = EGL_NO_SURFACE;
+    }
+    eglDestroySurface(mEglDisplay, eglSurface);
+    mAppliedSwapInterval.store(-1);
 
-    MirRectangle mirRect {0,0,0,0};
+    // Mir has no way to drop the buffers of a window's stream, reallocating them at 1x1 is the
+    // closest thing
+    mir_buffer_stream_set_size(mir_window_get_buffer_stream(mMirWindow), 1, 1);
 
-    if (mParentWindowHandle) {
-        qCDebug(mirclient,"updateGeometry(window=%p, x=%d, y=%d, width=%d, height=%d, child)", mWindow,
-                newGeometry.x(), newGeometry.y(), newGeometry.width(), newGeometry.height());
+    QSize bufferSize;
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        bufferSize = mBufferSize;
+    }
 
-        mirRect.left = newGeometry.x() - mParentWindowHandle->window()->x();
-        mirRect.top = newGeometry.y() - mParentWindowHandle->window()->y();
+    // Mir streams are triple buffered
+    const quint64 released = quint64(bufferSize.width()) * bufferSize.height()
+            * MIR_BYTES_PER_PIXEL(mPixelFormat) * 3;
+    qCDebug(mirclientGraphics, "releaseBuffers(window=%p) - stream reallocated at 1x1, about %llu KiB less",
+            mWindow, released / 1024);
+    mPlatformWindow->mFrameStats.recordBufferRelease(released);
+    return true;
+}
 
-    } else {
-        qCDebug(mirclient,"updateGeometry(window=%p, x=%d, y=%d, width=%d, height=%d, top-level)", mWindow,
-                newGeometry.x(), newGeometry.y(), newGeometry.width(), newGeometry.height());
+bool UbuntuSurface::restoreBuffers()
+{
+    {
+        QMutexLocker lock(&mPlatformWindow->mMutex);
+        mEglSurfaceReleasePending = false;
+    }
+    if (isPending() || mEglSurface != EGL_NO_SURFACE) {
+        return false;
+    }
 
-        mirRect.left = newGeometry.x();
-        mirRect.top = newGeometry.y();
+    // The render scale may have changed while the buffers were gone
+    const float renderScale = this->renderScale();
+    const QSize bufferSize = scaledSize(mPlatformWindow->geometry().size(), renderScale);
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        mBufferSize = bufferSize;
     }
 
-    mir_window_spec_set_placement(spec.get(), &mirRect,
-            mir_placement_gravity_northwest /* rect_gravity */, mir_placement_gravity_northwest /* surface_gravity */,
-            (MirPlacementHints)0, 0 /* offset_dx */, 0 /* offset_dy */);
+    qCDebug(mirclientGraphics, "restoreBuffers(window=%p, size=(%dx%d))", mWindow, bufferSize.width(), bufferSize.height());
+    MirBufferStream *stream = mir_window_get_buffer_stream(mMirWindow);
+    mir_buffer_stream_set_size(stream, bufferSize.width(), bufferSize.height());
+    mir_buffer_stream_set_scale(stream, renderScale);
 
-    mir_window_apply_spec(mMirWindow, spec.get());
+    // The released surface was never current when destroyed, so it is gone and the native window
+    // can have a new one
+    setEglSurface(eglCreateWindowSurface(mEglDisplay, mConfig, nativeWindowFor(mMirWindow), nullptr));
+    return true;
 }
 
-void UbuntuSurface::updateTitle(const QString& newTitle)
+void UbuntuSurface::aboutToMakeCurrent()
 {
-    const auto title = newTitle.toUtf8();
-    Spec spec{mir_create_window_spec(mConnection)};
-    mir_window_spec_set_name(spec.get(), title.constData());
-    mir_window_apply_spec(mMirWindow, spec.get());
+    QMutexLocker lock(&mPlatformWindow->mMutex);
+    mEglSurfaceCurrent = true;
 }
 
-void UbuntuSurface::setSizingConstraints(const QSize& minSize, const QSize& maxSize, const QSize& increment)
+void UbuntuSurface::doneCurrent()
 {
-    Spec spec{mir_create_window_spec(mConnection)};
-    ::setSizingConstraints(spec.get(), minSize, maxSize, increment);
-    mir_window_apply_spec(mMirWindow, spec.get());
+    QMutexLocker lock(&mPlatformWindow->mMutex);
+    mEglSurfaceCurrent = false;
+    if (mEglSurfaceReleasePending) {
+        mEglSurfaceReleasePending = false;
+        QMetaObject::invokeMethod(mPlatformWindow, "releaseHiddenBuffers", Qt::QueuedConnection);
+    }
 }
 
-void UbuntuSurface::handleSurfaceResized(int width, int height)
+int UbuntuSurface::bufferAge() const
 {
-    QMutexLocker lock(&mTargetSizeMutex);
+    static const bool supported = q_hasEglExtension(mEglDisplay, "EGL_EXT_buffer_age");
+    const EGLSurface eglSurface = mPlatformWindow->eglSurface();
+    EGLint age = 0;
+    if (supported && eglSurface != EGL_NO_SURFACE) {
+        eglQuerySurface(mEglDisplay, eglSurface, EGL_BUFFER_AGE_EXT, &age);
+    }
+    return age;
+}
 
-    // mir's resize event is mainly a signal that we need to redraw our content. We use the
-    // width/height as identifiers to figure out if this is the latest surface resize event
-    // that has posted, discarding any old ones. This avoids issuing too many redraw events.
-    // see TODO in postEvent as the ideal way we should handle this.
-    // The actual buffer size may or may have not changed at this point, so let the rendering
-    // thread drive the window geometry updates.
-    mNeedsRepaint = mTargetSize.width() == width && mTargetSize.height() == height;
+float UbuntuSurface::renderScale() const
+{
+    QMutexLocker lock(&mTargetSizeMutex);
+    return mRenderScale;
 }
 
-int UbuntuSurface::needsRepaint() const
+void UbuntuSurface::setRenderScale(float scale)
 {
-    if (mNeedsRepaint) {
-        if (mTargetSize != mBufferSize) {
-            //If the buffer hasn't changed yet, we need at least two redraws,
-            //once to get the new buffer size and propagate the geometry changes
-            //and the second to redraw the content at the new size
-            return 2;
-        } else {
-            // The buffer size has already been updated so we only need one redraw
-            // to render at the new size
-            return 1;
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        if (qFuzzyCompare(scale, mRenderScale)) {
+            return;
         }
+        mRenderScale = scale;
+    }
+
+    // Otherwise applied once the window exists or its buffers are back
+    if (!isPending() && mEglSurface != EGL_NO_SURFACE) {
+        mir_buffer_stream_set_scale(mir_window_get_buffer_stream(mMirWindow), scale);
     }
-    return 0;
 }
 
-void UbuntuSurface::setState(MirWindowState state)
+QSurfaceFormat UbuntuSurface::format() const
 {
-    mir_window_set_state(mMirWindow, state);
+    auto format = mFormat;
+    const int swapInterval = mSwapInterval.load();
+    if (swapInterval >= 0) {
+        format.setSwapInterval(swapInterval);
+    }
+    return format;
 }
 
-void UbuntuSurface::setShellChrome(MirShellChrome chrome)
+// Must be called with the surface current. On Mir, eglSwapInterval sets the interval of the
+// window's buffer stream; going through EGL keeps the driver's idea of it in step.
+void UbuntuSurface::syncSwapInterval()
 {
-    if (chrome != mShellChrome) {
-        auto spec = Spec{mir_create_window_spec(mConnection)};
-        mir_window_spec_set_shell_chrome(spec.get(), chrome);
-        mir_window_apply_spec(mMirWindow, spec.get());
+    const int swapInterval = mSwapInterval.load();
+    const int appliedSwapInterval = mAppliedSwapInterval.load();
+    if (swapInterval < 0 || swapInterval == appliedSwapInterval || mPlatformWindow->eglSurface() == EGL_NO_SURFACE) {
+        return;
+    }
 
-        mShellChrome = chrome;
+    qCDebug(mirclientGraphics, "syncSwapInterval(window=%p, interval=%d)", mWindow, swapInterval);
+    if (eglSwapInterval(mEglDisplay, swapInterval) != EGL_TRUE) {
+        qCWarning(mirclientGraphics, "eglSwapInterval(%d) failed for window %p", swapInterval, mWindow);
     }
+    // Not retried on failure, that would cost a round trip every frame. Should releaseBuffers() have
+    // reset it meanwhile, this went to the dying surface and has to be redone for the next one.
+    mAppliedSwapInterval.testAndSetOrdered(appliedSwapInterval, swapInterval);
 }
 
-void UbuntuSurface::onSwapBuffersDone()
+// The recycled window is hidden, but still has the size, placement, title and input shape of
+// the window that used it last
+void UbuntuSurface::adoptRecycledWindow(const QMirClientSurfacePool::Surface &recycled)
 {
-    static int sFrameNumber = 0;
-    ++sFrameNumber;
-
-    EGLint eglSurfaceWidth = -1;
-    EGLint eglSurfaceHeight = -1;
-    eglQuerySurface(mEglDisplay, mEglSurface, EGL_WIDTH, &eglSurfaceWidth);
-    eglQuerySurface(mEglDisplay, mEglSurface, EGL_HEIGHT, &eglSurfaceHeight);
-
-    const bool validSize = eglSurfaceWidth > 0 && eglSurfaceHeight > 0;
+    qCDebug(mirclient, "UbuntuSurface(window=%p) - reusing recycled Mir window %p", mWindow, recycled.window);
 
-    if (validSize && (mBufferSize.width() != eglSurfaceWidth || mBufferSize.height() != eglSurfaceHeight)) {
-
-        qCDebug(mirclientBufferSwap, "onSwapBuffersDone(window=%p) [%d] - size changed (%d, %d) => (%d, %d)",
-               mWindow, sFrameNumber, mBufferSize.width(), mBufferSize.height(), eglSurfaceWidth, eglSurfaceHeight);
+    mEventSink = std::static_pointer_cast<EventSink>(recycled.context);
+    {
+        QMutexLocker lock(&mEventSink->mutex);
+        mEventSink->surface = this;
+    }
+    mAppliedState = mir_window_state_hidden;
 
-        mBufferSize.rwidth() = eglSurfaceWidth;
-        mBufferSize.rheight() = eglSurfaceHeight;
+    initializeMirWindow(recycled.window, recycled.eglSurface);
 
-        QRect newGeometry = mPlatformWindow->geometry();
-        newGeometry.setSize(mBufferSize);
+    updateGeometry(mWindow->geometry());
+    updateTitle(mWindow->title());
+    setSizingConstraints(mWindow->minimumSize(), mWindow->maximumSize(), mWindow->sizeIncrement());
+    ::setMask(pendingSpec(), mMask, mMaskRects);
+    if (mShellChrome != mir_shell_chrome_normal) {
+        mir_window_spec_set_shell_chrome(pendingSpec(), mShellChrome);
+    }
+    applyPendingSpec();
+    if (mState != mAppliedState) {
+        mir_window_set_state(mMirWindow, mState);
+        mAppliedState = mState;
+    }
+}
 
-        mPlatformWindow->QPlatformWindow::setGeometry(newGeometry);
-        QWindowSystemInterface::handleGeometryChange(mWindow, newGeometry);
-    } else {
-        qCDebug(mirclientBufferSwap, "onSwapBuffersDone(window=%p) [%d] - buffer size (%d,%d)",
-               mWindow, sFrameNumber, mBufferSize.width(), mBufferSize.height());
+QMirClientSurfacePool::Surface UbuntuSurface::createSpeculative(MirConnection *connection, EGLDisplay display,
+                                                                QMirClientEglConfigCache *configCache,
+                                                                const QSize &size, QMirClientSurfacePool::Key *key)
+{
+    // The format QtQuick windows ask for, see QSGContext::defaultSurfaceFormat()
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setDepthBufferSize(qEnvironmentVariableIsEmpty("QSG_NO_DEPTH_BUFFER") ? 24 : 0);
+    format.setStencilBufferSize(qEnvironmentVariableIsEmpty("QSG_NO_STENCIL_BUFFER") ? 8 : 0);
+
+    const auto surfaceConfig = configCache->configForFormat(format);
+    *key = QMirClientSurfacePool::Key{mir_window_type_normal, surfaceConfig.config, surfaceConfig.pixelFormat, nullptr};
+
+    // Events are dropped until a surface adopts the window
+    auto eventSink = std::make_shared<EventSink>();
+
+    Spec spec{mir_create_normal_window_spec(connection, qMax(1, size.width()), qMax(1, size.height()))};
+    mir_window_spec_set_pixel_format(spec.get(), surfaceConfig.pixelFormat);
+    mir_window_spec_set_event_handler(spec.get(), surfaceEventCallback, eventSink.get());
+    mir_window_spec_set_state(spec.get(), mir_window_state_hidden);
+
+    auto window = mir_create_window_sync(spec.get());
+    if (!mir_window_is_valid(window)) {
+        qCWarning(mirclient) << "Mir failed to create a speculative window:" << mir_window_get_error_message(window);
+        mir_window_release_sync(window);
+        return QMirClientSurfacePool::Surface{};
     }
+
+    auto eglSurface = eglCreateWindowSurface(display, surfaceConfig.config, nativeWindowFor(window), nullptr);
+    return QMirClientSurfacePool::Surface{window, eglSurface, eventSink};
 }
 
-void UbuntuSurface::surfaceEventCallback(MirWindow *surface, const MirEvent *event, void* context)
+void UbuntuSurface::updateGeometry(const QRect &newGeometry)
 {
-    Q_UNUSED(surface);
-    Q_ASSERT(context != nullptr);
+    const qint64 now = mGeometryClock.elapsed();
+    if (mGeometryInFlight) {
+        if (mGeometryQueued) {
+            ++mReplacedGeometryRequests;
+        }
+        mGeometryQueued = true;
+        mQueuedGeometry = newGeometry;
+        mQueuedAt = now;
+        return;
+    }
 
-    auto s = static_cast<UbuntuSurface *>(context);
-    s->postEvent(event);
+    sendGeometry(newGeometry, now);
 }
 
-void UbuntuSurface::postEvent(const MirEvent *event)
+void UbuntuSurface::sendGeometry(const QRect &newGeometry, qint64 requestedAt)
 {
-    const auto eventType = mir_event_get_type(event);
-    if (mir_event_type_resize == eventType) {
-        // TODO: The current event queue just accumulates all resize events;
-        // It would be nicer if we could update just one event if that event has not been dispatched.
-        // As a workaround, we use the width/height as an identifier of this latest event
-        // so the event handler (handleSurfaceResized) can discard/ignore old ones.
+    auto spec = pendingSpec();
+
+    mir_window_spec_set_width(spec, newGeometry.width());
+    mir_window_spec_set_height(spec, newGeometry.height());
+
+    MirRectangle mirRect {0,0,0,0};
+
+    if (mParentWindowHandle) {
+        qCDebug(mirclient,"updateGeometry(window=%p, x=%d, y=%d, width=%d, height=%d, child)", mWindow,
+                newGeometry.x(), newGeometry.y(), newGeometry.width(), newGeometry.height());
+
+        mirRect.left = newGeometry.x() - mParentWindowHandle->window()->x();
+        mirRect.top = newGeometry.y() - mParentWindowHandle->window()->y();
+
+    } else {
+        qCDebug(mirclient,"updateGeometry(window=%p, x=%d, y=%d, width=%d, height=%d, top-level)", mWindow,
+                newGeometry.x(), newGeometry.y(), newGeometry.width(), newGeometry.height());
+
+        mirRect.left = newGeometry.x();
+        mirRect.top = newGeometry.y();
+    }
+
+    // Menus and tips are created attached with mir_edge_attachment_any, which lets the server flip
+    // or slide them to keep them on screen. Recycled ones are only ever placed here, which has to
+    // do the same for them to behave like fresh ones near the edges of the screen.
+    if (mPoolKey.type == mir_window_type_menu || mPoolKey.type == mir_window_type_tip) {
+        mir_window_spec_set_placement(spec, &mirRect,
+                mir_placement_gravity_southwest /* rect_gravity */, mir_placement_gravity_northwest /* surface_gravity */,
+                MirPlacementHints(mir_placement_hints_flip_any | mir_placement_hints_slide_any),
+                0 /* offset_dx */, 0 /* offset_dy */);
+    } else {
+        mir_window_spec_set_placement(spec, &mirRect,
+                mir_placement_gravity_northwest /* rect_gravity */, mir_placement_gravity_northwest /* surface_gravity */,
+                (MirPlacementHints)0, 0 /* offset_dx */, 0 /* offset_dy */);
+    }
+
+    // Moves don't get a resize event back, so only a new size starts the clock
+    const QSize size = newGeometry.size();
+    if (size != mSize && (size != mAwaitedSize || mAwaitedSince < 0)) {
+        mAwaitedSize = size;
+        mAwaitedSince = requestedAt;
+    }
+
+    // Outputs may not have reported their refresh rate yet
+    const qreal screenRefreshRate = mWindow->screen() ? mWindow->screen()->refreshRate() : 0;
+    const qreal refreshRate = screenRefreshRate > 0 ? screenRefreshRate : 60;
+    mGeometryInFlight = true;
+    mGeometryFrameTimer.start(qMax(1, qRound(1000 / refreshRate)));
+}
+
+void UbuntuSurface::releaseGeometryFrame()
+{
+    mGeometryFrameTimer.stop();
+    mGeometryInFlight = false;
+
+    if (mGeometryQueued) {
+        mGeometryQueued = false;
+        sendGeometry(mQueuedGeometry, mQueuedAt);
+    }
+}
+
+// Called with each size Mir sends, whether or not we asked for it
+void UbuntuSurface::confirmGeometry(const QSize &size)
+{
+    mSize = size;
+    if (mAwaitedSince >= 0 && size == mAwaitedSize) {
+        const qint64 latency = mGeometryClock.elapsed() - mAwaitedSince;
+        mAwaitedSince = -1;
+        ++mConfirmedGeometryRequests;
+        mTotalGeometryLatency += latency;
+
+        qCDebug(mirclient, "confirmGeometry(window=%p, size=(%dx%d)) - took %lldms (average %lldms over %llu, %llu requests replaced)",
+                mWindow, size.width(), size.height(), latency,
+                mTotalGeometryLatency / qint64(mConfirmedGeometryRequests), mConfirmedGeometryRequests,
+                mReplacedGeometryRequests);
+    }
+
+    // Mir has answered, no need to wait for the end of the frame to send the next request
+    if (mGeometryInFlight) {
+        releaseGeometryFrame();
+    }
+}
+
+void UbuntuSurface::updateTitle(const QString& newTitle)
+{
+    const auto title = newTitle.toUtf8();
+    mir_window_spec_set_name(pendingSpec(), title.constData());
+}
+
+void UbuntuSurface::setSizingConstraints(const QSize& minSize, const QSize& maxSize, const QSize& increment)
+{
+    ::setSizingConstraints(pendingSpec(), minSize, maxSize, increment);
+}
+
+QSize UbuntuSurface::takePendingResize()
+{
+    QSize size;
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        if (!mResizePending) {
+            return QSize();
+        }
+        mResizePending = false;
+
+        // mir's resize event is mainly a signal that we need to redraw our content.
+        // The actual buffer size may or may have not changed at this point, so let the rendering
+        // thread drive the window geometry updates.
+        mNeedsRepaint = true;
+        mResizeRenders = 0;
+        size = mTargetSize;
+    }
+
+    confirmGeometry(size);
+    return size;
+}
+
+bool UbuntuSurface::needsRepaint()
+{
+    QMutexLocker lock(&mTargetSizeMutex);
+    return mNeedsRepaint;
+}
+
+void UbuntuSurface::setState(MirWindowState state)
+{
+    mState = state;
+    if (isPending()) {
+        return;
+    }
+
+    // State changes are not part of the spec, so make sure the server sees any
+    // earlier changes (e.g. parenting a dialog) before the window changes state
+    applyPendingSpec();
+    mir_window_set_state(mMirWindow, state);
+    mAppliedState = state;
+}
+
+void UbuntuSurface::setShellChrome(MirShellChrome chrome)
+{
+    if (chrome != mShellChrome) {
+        mir_window_spec_set_shell_chrome(pendingSpec(), chrome);
+        mShellChrome = chrome;
+    }
+}
+
+MirWindowSpec *UbuntuSurface::pendingSpec()
+{
+    if (!mPendingSpec) {
+        mPendingSpec = Spec{mir_create_window_spec(mConnection)};
+        // Apply once control returns to the event loop, so changes made in the meantime get merged
+        QMetaObject::invokeMethod(mPlatformWindow, "applyPendingSpec", Qt::QueuedConnection);
+    }
+    ++mPendingSpecChanges;
+    return mPendingSpec.get();
+}
+
+void UbuntuSurface::applyPendingSpec()
+{
+    if (!mPendingSpec || isPending()) {
+        return;
+    }
+
+    mir_window_apply_spec(mMirWindow, mPendingSpec.get());
+    mPendingSpec.reset();
+
+    ++mAppliedSpecCount;
+    mMergedSpecCount += mPendingSpecChanges - 1;
+
+    qCDebug(mirclient, "applyPendingSpec(window=%p) - %d change(s) in one spec (total: %llu applied, %llu merged)",
+            mWindow, mPendingSpecChanges, mAppliedSpecCount, mMergedSpecCount);
+    mPendingSpecChanges = 0;
+}
+
+bool UbuntuSurface::onSwapBuffersDone()
+{
+    // Already counted by the platform window
+    const quint64 frameNumber = mPlatformWindow->mFrameStats.frameCount();
+
+    // Size of the buffer this frame was rendered into
+    QSize renderedSize;
+    float renderScale;
+    {
+        QMutexLocker lock(&mTargetSizeMutex);
+        renderedSize = mBufferSize;
+        renderScale = mRenderScale;
+    }
+
+    EGLint eglSurfaceWidth = -1;
+    EGLint eglSurfaceHeight = -1;
+    const EGLSurface eglSurface = mPlatformWindow->eglSurface();
+    eglQuerySurface(mEglDisplay, eglSurface, EGL_WIDTH, &eglSurfaceWidth);
+    eglQuerySurface(mEglDisplay, eglSurface, EGL_HEIGHT, &eglSurfaceHeight);
+
+    const bool validSize = eglSurfaceWidth > 0 && eglSurfaceHeight > 0;
+
+    if (validSize && (renderedSize.width() != eglSurfaceWidth || renderedSize.height() != eglSurfaceHeight)) {
+
+        qCDebug(mirclientBufferSwap, "onSwapBuffersDone(window=%p) [%llu] - size changed (%d, %d) => (%d, %d)",
+               mWindow, frameNumber, renderedSize.width(), renderedSize.height(), eglSurfaceWidth, eglSurfaceHeight);
+
+        const QSize bufferSize(eglSurfaceWidth, eglSurfaceHeight);
+        {
+            QMutexLocker lock(&mTargetSizeMutex);
+            mBufferSize = bufferSize;
+        }
+
+        // With a render scale the buffers get resized when the scale changes, while the window doesn't
+        QRect newGeometry = mPlatformWindow->geometry();
+        if (!bufferSizeMatches(bufferSize, newGeometry.size(), renderScale)) {
+            newGeometry.setSize(scaledSize(bufferSize, 1 / renderScale));
+
+            mPlatformWindow->updatePlatformGeometry(newGeometry);
+            QWindowSystemInterface::handleGeometryChange(mWindow, newGeometry);
+        }
+    } else {
+        qCDebug(mirclientBufferSwap, "onSwapBuffersDone(window=%p) [%llu] - buffer size (%d,%d)",
+               mWindow, frameNumber, renderedSize.width(), renderedSize.height());
+    }
+
+    QMutexLocker lock(&mTargetSizeMutex);
+    if (!mNeedsRepaint) {
+        return false;
+    }
+
+    ++mResizeRenders;
+
+    // Give up after a few frames should the server never hand us a buffer of the requested size
+    const int maxResizeRenders = 3;
+    if (!bufferSizeMatches(renderedSize, mTargetSize, renderScale) && mResizeRenders < maxResizeRenders) {
+        qCDebug(mirclientBufferSwap, "onSwapBuffersDone(window=%p) [%llu] - rendered at stale size (%d,%d), repainting",
+                mWindow, frameNumber, renderedSize.width(), renderedSize.height());
+        return true;
+    }
+
+    mNeedsRepaint = false;
+    qCDebug(mirclient, "onSwapBuffersDone(window=%p) - resize took %d render(s)", mWindow, mResizeRenders);
+    return false;
+}
+
+void UbuntuSurface::surfaceEventCallback(MirWindow *surface, const MirEvent *event, void* context)
+{
+    Q_UNUSED(surface);
+    Q_ASSERT(context != nullptr);
+
+    auto sink = static_cast<EventSink *>(context);
+    QMutexLocker lock(&sink->mutex);
+    if (sink->surface) {
+        sink->surface->postEvent(event);
+    }
+}
+
+void UbuntuSurface::postEvent(const MirEvent *event)
+{
+    const auto eventType = mir_event_get_type(event);
+    if (mir_event_type_resize == eventType) {
+        // Only keep the latest size. If a resize event is already queued it will pick this size up
+        // (see takePendingResize), so there is no point queueing another one.
         const auto resizeEvent = mir_event_get_resize_event(event);
         const auto width =  mir_resize_event_get_width(resizeEvent);
         const auto height =  mir_resize_event_get_height(resizeEvent);
@@ -704,6 +1491,13 @@ void UbuntuSurface::postEvent(const MirEvent *event)
         QMutexLocker lock(&mTargetSizeMutex);
         mTargetSize.rwidth() = width;
         mTargetSize.rheight() = height;
+        if (mResizePending) {
+            ++mCoalescedResizeCount;
+            qCDebug(mirclient, "resizeEvent(window=%p) - coalesced with queued resize (%llu so far)",
+                    mWindow, mCoalescedResizeCount);
+            return;
+        }
+        mResizePending = true;
     }
 
     mInput->postEvent(mPlatformWindow, event);
@@ -714,28 +1508,59 @@ void UbuntuSurface::setSurfaceParent(MirWindow* parent)
     qCDebug(mirclient, "setSurfaceParent(window=%p)", mWindow);
 
     mParented = true;
-    Spec spec{mir_create_window_spec(mConnection)};
-    mir_window_spec_set_parent(spec.get(), parent);
-    mir_window_apply_spec(mMirWindow, spec.get());
+    mir_window_spec_set_parent(pendingSpec(), parent);
 }
 
 void UbuntuSurface::setMask(const QRegion &region)
 {
+    if (region == mMask) {
+        return;
+    }
+    mMask = region;
+
     qCDebug(mirclient).nospace() << "setMask(window=" << mWindow << ", region=" << region << ")";
 
-    Spec spec{mir_create_window_spec(mConnection)};
-    ::setMask(spec.get(), region);
-    mir_window_apply_spec(mMirWindow, spec.get());
+    ::setMask(pendingSpec(), region, mMaskRects);
 }
 
-QString UbuntuSurface::persistentSurfaceId()
+void UbuntuSurface::requestPersistentSurfaceId()
 {
-    if (mPersistentIdStr.isEmpty()) {
-        auto id = mir_window_request_window_id_sync(mMirWindow);
-        mPersistentIdStr = mir_window_id_as_string(id);
-        mir_window_id_release(id);
+    mPersistentId = std::make_shared<PersistentIdRequest>();
+    mPersistentId->platformWindow = mPlatformWindow;
+
+    // The callback owns this extra reference
+    mir_window_request_window_id(mMirWindow, persistentIdCallback,
+                                 new std::shared_ptr<PersistentIdRequest>(mPersistentId));
+}
+
+void UbuntuSurface::persistentIdCallback(MirWindow *window, MirWindowId *id, void *context)
+{
+    Q_UNUSED(window);
+    Q_ASSERT(context != nullptr);
+
+    std::unique_ptr<std::shared_ptr<PersistentIdRequest>> request{
+            static_cast<std::shared_ptr<PersistentIdRequest> *>(context)};
+
+    QMutexLocker lock(&(*request)->mutex);
+    if (mir_window_id_is_valid(id)) {
+        (*request)->id = mir_window_id_as_string(id);
+    } else {
+        qCWarning(mirclient, "Mir failed to provide a persistent surface id");
+    }
+    mir_window_id_release(id);
+
+    if ((*request)->platformWindow) {
+        QMetaObject::invokeMethod((*request)->platformWindow, "onPersistentSurfaceIdReady", Qt::QueuedConnection);
+    }
+}
+
+QString UbuntuSurface::persistentSurfaceId() const
+{
+    if (!mPersistentId) {
+        return QString();
     }
-    return mPersistentIdStr;
+    QMutexLocker lock(&mPersistentId->mutex);
+    return mPersistentId->id;
 }
 
 Q_DECLARE_METATYPE(QPlatformWindow*)
@@ -745,16 +1570,19 @@ QMirClientWindow::QMirClientWindow(QWindow *w, QMirClientInput *input, QMirClien
                                    MirConnection *mirConnection, QMirClientDebugExtension *debugExt)
     : QObject(nullptr)
     , QPlatformWindow(w)
-    , mId(makeId())
+    , mId(QMirClientWindowRegistry::makeId())
     , mWindowState(w->windowState())
     , mWindowFlags(w->flags())
     , mWindowVisible(false)
     , mAppStateController(appState)
     , mDebugExtention(debugExt)
     , mNativeInterface(native)
+    , mRegistry(input->integration()->windowRegistry())
     , mSurface(new UbuntuSurface{this, eglDisplay, input, mirConnection})
     , mScale(1.0)
     , mFormFactor(mir_form_factor_unknown)
+    , mFrameStats(w)
+    , mFrameScheduler([this]() { deliverExpose(); }, [this]() { deliverUpdateRequest(); })
 {
     static bool metaTypeRegistered = false;
     if (Q_UNLIKELY(!metaTypeRegistered)) {
@@ -762,55 +1590,119 @@ QMirClientWindow::QMirClientWindow(QWindow *w, QMirClientInput *input, QMirClien
         metaTypeRegistered = true;
     }
 
+    // Before the Mir window exists, its events are routed by id
+    mRegistry->addWindow(this, mId);
+    mSurface->create();
+
     mWindowExposed = mSurface->mNeedsExposeCatchup == false;
+    mRequestedRenderScale = mSurface->renderScale();
+    mRenderScaleAdaptive.store(w->surfaceType() == QSurface::RasterSurface);
 
     qCDebug(mirclient, "QMirClientWindow(window=%p, screen=%p, input=%p, surf=%p) with title '%s'",
             w, w->screen()->handle(), input, mSurface.get(), qPrintable(window()->title()));
 
+    mFrameStats.setRefreshRate(w->screen()->refreshRate());
+    mFrameScheduler.setRefreshRate(w->screen()->refreshRate());
+
+    mBufferingMode = bufferingModeFor(w->requestedFormat().swapBehavior());
+    if (mBufferingMode != BufferingMode::Default) {
+        applyBufferingMode();
+    } else {
+        mFrameStats.setBufferingMode(bufferingMode());
+    }
+
+    mReleaseBuffersTimer.setSingleShot(true);
+    connect(&mReleaseBuffersTimer, &QTimer::timeout, this, &QMirClientWindow::releaseHiddenBuffers);
+
     updatePanelHeightHack(mSurface->state() != mir_window_state_fullscreen);
 
-    // queue the windowPropertyChanged signal. If it's emitted directly, the platformWindow will not yet be set for the window.
-    QMetaObject::invokeMethod(mNativeInterface, "windowPropertyChanged", Qt::QueuedConnection,
-                              Q_ARG(QPlatformWindow*, this),
-                              Q_ARG(QString, "persistentSurfaceId"));
+    // windowPropertyChanged for "persistentSurfaceId" is emitted once Mir has answered the request
+    // made at window creation, see onPersistentSurfaceIdReady().
 }
 
 QMirClientWindow::~QMirClientWindow()
 {
     qCDebug(mirclient, "~QMirClientWindow(window=%p)", this);
+    mRegistry->removeWindow(mId);
 }
 
 void QMirClientWindow::handleSurfaceResized(int width, int height)
 {
-    QMutexLocker lock(&mMutex);
+    invalidateScreenOrigin();
     qCDebug(mirclient, "handleSurfaceResize(window=%p, size=(%dx%d)px", window(), width, height);
 
-    mSurface->handleSurfaceResized(width, height);
-
     // This resize event could have occurred just after the last buffer swap for this window.
-    // This means the client may still be holding a buffer with the older size. The first redraw call
-    // will then render at the old size. After swapping the client now will get a new buffer with the
-    // updated size but it still needs re-rendering so another redraw may be needed.
+    // This means the client may still be holding a buffer with the older size, and the frame will
+    // then render at the old size. Rather than always redrawing twice, draw once and let
+    // onSwapBuffersDone() ask for another frame only if the swapped buffer turns out to be stale.
     // A mir API to drop the currently held buffer would help here, so that we wouldn't have to redraw twice
-    auto const numRepaints = mSurface->needsRepaint();
-    lock.unlock();
-    qCDebug(mirclient, "handleSurfaceResize(window=%p) redraw %d times", window(), numRepaints);
-    for (int i = 0; i < numRepaints; i++) {
+    if (mSurface->needsRepaint()) {
         qCDebug(mirclient, "handleSurfaceResize(window=%p) repainting size=(%dx%d)dp", window(), geometry().size().width(), geometry().size().height());
-        QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+        mFrameScheduler.scheduleExpose();
     }
 }
 
+QSize QMirClientWindow::takePendingResize()
+{
+    return mSurface->takePendingResize();
+}
+
+QMirClientSurfacePool::Surface QMirClientWindow::createSpeculativeSurface(MirConnection *connection, EGLDisplay display,
+                                                                          QMirClientEglConfigCache *configCache,
+                                                                          const QSize &size, QMirClientSurfacePool::Key *key)
+{
+    return UbuntuSurface::createSpeculative(connection, display, configCache, size, key);
+}
+
+// Repaints that don't come with a change of exposure are paced, see QMirClientFrameScheduler
+void QMirClientWindow::scheduleExpose()
+{
+    mFrameScheduler.scheduleExpose();
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+// What the basic render loop and animations repaint through, paced like exposes so that the frame
+// rate cap also holds for windows rendering on the GUI thread
+void QMirClientWindow::requestUpdate()
+{
+    mFrameScheduler.scheduleUpdate();
+}
+#endif
+
+void QMirClientWindow::deliverExpose()
+{
+    // Unexposed windows don't render, waiting for their frame would count the next one as late
+    if (isExposed()) {
+        mFrameStats.recordFrameRequest();
+    }
+    QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+}
+
+void QMirClientWindow::deliverUpdateRequest()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    mFrameStats.recordFrameRequest();
+    QWindowPrivate::get(window())->deliverUpdateRequest();
+#endif
+}
+
 void QMirClientWindow::handleSurfaceExposeChange(bool exposed)
 {
-    QMutexLocker lock(&mMutex);
     qCDebug(mirclient, "handleSurfaceExposeChange(window=%p, exposed=%s)", window(), exposed ? "true" : "false");
 
+    mWindowOccluded = !exposed;
+    updateThrottling();
+
+    // Occluded windows stop rendering, unless they are given a reduced frame rate to keep going at
+    const bool renders = exposed || occludedFrameRate() > 0;
+
+    QMutexLocker lock(&mMutex);
     mSurface->mNeedsExposeCatchup = false;
-    if (mWindowExposed == exposed) return;
-    mWindowExposed = exposed;
+    if (mWindowExposed == renders) return;
+    mWindowExposed = renders;
 
     lock.unlock();
+    mFrameScheduler.exposureChanged();
     QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
 }
 
@@ -818,6 +1710,9 @@ void QMirClientWindow::handleSurfaceFocusChanged(bool focused)
 {
     qCDebug(mirclient, "handleSurfaceFocusChanged(window=%p, focused=%d)", window(), focused);
 
+    mWindowFocused = focused;
+    updateThrottling();
+
     if (focused) {
         mAppStateController->setWindowFocused(true);
         QWindowSystemInterface::handleWindowActivated(window(), Qt::ActiveWindowFocusReason);
@@ -839,6 +1734,8 @@ void QMirClientWindow::handleSurfaceVisibilityChanged(bool visible)
     if (mWindowVisible == visible) return;
     mWindowVisible = visible;
 
+    mFrameScheduler.exposureChanged();
+    updateBufferRelease();
     QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
 }
 
@@ -849,24 +1746,25 @@ void QMirClientWindow::handleSurfaceStateChanged(Qt::WindowState state)
     if (mWindowState == state) return;
     mWindowState = state;
 
+    // Maximizing and restoring move the window
+    invalidateScreenOrigin();
+    updateBufferRelease();
     QWindowSystemInterface::handleWindowStateChanged(window(), state);
 }
 
 void QMirClientWindow::setWindowState(Qt::WindowState state)
 {
-    QMutexLocker lock(&mMutex);
     qCDebug(mirclient, "setWindowState(window=%p, %s)", this, qtWindowStateToStr(state));
 
     if (mWindowState == state) return;
     mWindowState = state;
 
-    lock.unlock();
     updateSurfaceState();
+    updateBufferRelease();
 }
 
 void QMirClientWindow::setWindowFlags(Qt::WindowFlags flags)
 {
-    QMutexLocker lock(&mMutex);
     qCDebug(mirclient, "setWindowFlags(window=%p, 0x%x)", this, (int)flags);
 
     if (mWindowFlags == flags) return;
@@ -887,37 +1785,88 @@ void QMirClientWindow::updatePanelHeightHack(bool enable)
         return;
     }
 
-    QMutexLocker lock(&mMutex);
-
-    QRect newGeometry = geometry();
+    const QRect oldGeometry = geometry();
+    QRect newGeometry = oldGeometry;
     if (enable) {
         newGeometry.moveTop(panelHeight());
     } else {
         newGeometry.moveTop(0);
     }
 
-    if (newGeometry != geometry()) {
-        lock.unlock();
-        QPlatformWindow::setGeometry(newGeometry);
+    if (newGeometry != oldGeometry) {
+        updatePlatformGeometry(newGeometry);
         QWindowSystemInterface::handleGeometryChange(window(), newGeometry);
     }
 }
 
 QRect QMirClientWindow::geometry() const
 {
-    if (mDebugExtention) {
-        auto geom = QPlatformWindow::geometry();
-        geom.moveTopLeft(mDebugExtention->mapWindowPointToScreen(mSurface->mirWindow(), QPoint(0,0)));
-        return geom;
-    } else {
-        return QPlatformWindow::geometry();
+    QRect geom;
+    {
+        QMutexLocker lock(&mMutex);
+        geom = QPlatformWindow::geometry();
+    }
+
+    if (mDebugExtention && !mSurface->isPending()) {
+        geom.moveTopLeft(screenOrigin());
     }
+    return geom;
 }
 
-void QMirClientWindow::setGeometry(const QRect &rect)
+/*
+    Asking the debug extension where the window is costs a server round trip, and geometry() is
+    called for every touch event. Windows are only ever translated, so the position of their origin
+    is enough to map any point, and it only changes when the window is moved, resized or changes
+    screen, see invalidateScreenOrigin().
+ */
+QPoint QMirClientWindow::screenOrigin() const
+{
+    int generation;
+    {
+        QMutexLocker lock(&mMutex);
+        if (mScreenOriginValid) {
+            return mScreenOrigin;
+        }
+        generation = mScreenOriginGeneration;
+    }
+
+    const QPoint origin = mDebugExtention->mapWindowPointToScreen(mSurface->mirWindow(), QPoint(0,0));
+
+    QMutexLocker lock(&mMutex);
+    ++mScreenOriginTranslations;
+    qCDebug(mirclientDebug, "screenOrigin(window=%p) - translation %d asked of the server",
+            window(), mScreenOriginTranslations);
+    // Unless the window moved while we were asking
+    if (generation == mScreenOriginGeneration) {
+        mScreenOrigin = origin;
+        mScreenOriginValid = true;
+    }
+    return origin;
+}
+
+void QMirClientWindow::invalidateScreenOrigin()
 {
     QMutexLocker lock(&mMutex);
+    mScreenOriginValid = false;
+    ++mScreenOriginGeneration;
+}
+
+void QMirClientWindow::updatePlatformGeometry(const QRect &geometry)
+{
+    invalidateScreenOrigin();
+
+    QMutexLocker lock(&mMutex);
+    QPlatformWindow::setGeometry(geometry);
+}
 
+void QMirClientWindow::handleSurfacePlacementChanged()
+{
+    qCDebug(mirclient, "handleSurfacePlacementChanged(window=%p)", window());
+    invalidateScreenOrigin();
+}
+
+void QMirClientWindow::setGeometry(const QRect &rect)
+{
     if (window()->windowState() == Qt::WindowFullScreen || window()->windowState() == Qt::WindowMaximized) {
         qCDebug(mirclient, "setGeometry(window=%p) - not resizing, window is maximized or fullscreen", window());
         return;
@@ -928,7 +1877,7 @@ void QMirClientWindow::setGeometry(const QRect &rect)
     // Immediately update internal geometry so Qt believes position updated
     QRect newPosition(geometry());
     newPosition.moveTo(rect.topLeft());
-    QPlatformWindow::setGeometry(newPosition);
+    updatePlatformGeometry(newPosition);
 
     mSurface->updateGeometry(rect);
     // Note: don't call handleGeometryChange here, wait to see what Mir replies with.
@@ -936,7 +1885,6 @@ void QMirClientWindow::setGeometry(const QRect &rect)
 
 void QMirClientWindow::setVisible(bool visible)
 {
-    QMutexLocker lock(&mMutex);
     qCDebug(mirclient, "setVisible (window=%p, visible=%s)", window(), visible ? "true" : "false");
 
     if (mWindowVisible == visible) return;
@@ -948,26 +1896,26 @@ void QMirClientWindow::setVisible(bool visible)
             // so morph it into a modal dialog
             auto parent = transientParentFor(window());
             if (parent) {
+                parent->waitForMirWindow(); // may still be on its way
                 mSurface->setSurfaceParent(parent->mirWindow());
             }
         }
     }
 
-    lock.unlock();
     updateSurfaceState();
+    mFrameScheduler.exposureChanged();
+    updateBufferRelease();
     QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
 }
 
 void QMirClientWindow::setWindowTitle(const QString& title)
 {
-    QMutexLocker lock(&mMutex);
     qCDebug(mirclient, "setWindowTitle(window=%p) title=%s)", window(), title.toUtf8().constData());
     mSurface->updateTitle(title);
 }
 
 void QMirClientWindow::propagateSizeHints()
 {
-    QMutexLocker lock(&mMutex);
     const auto win = window();
     qCDebug(mirclient, "propagateSizeHints(window=%p) min(%d,%d), max(%d,%d) increment(%d, %d)",
             win, win->minimumSize().width(), win->minimumSize().height(),
@@ -978,8 +1926,16 @@ void QMirClientWindow::propagateSizeHints()
 
 bool QMirClientWindow::isExposed() const
 {
+    if (!mSurface || mSurface->isPending()) {
+        return false;
+    }
+
     // mNeedsExposeCatchup because we need to render a frame to get the expose surface event from mir.
-    return mWindowVisible && (mWindowExposed || (mSurface && mSurface->mNeedsExposeCatchup));
+    QMutexLocker lock(&mMutex);
+    if (mSurface->eglSurface() == EGL_NO_SURFACE) {
+        return false;
+    }
+    return mWindowVisible && !mThrottlePaused && (mWindowExposed || mSurface->mNeedsExposeCatchup);
 }
 
 void QMirClientWindow::setMask(const QRegion &region)
@@ -994,8 +1950,8 @@ QSurfaceFormat QMirClientWindow::format() const
 
 QPoint QMirClientWindow::mapToGlobal(const QPoint &pos) const
 {
-    if (mDebugExtention) {
-        return mDebugExtention->mapWindowPointToScreen(mSurface->mirWindow(), pos);
+    if (mDebugExtention && !mSurface->isPending()) {
+        return screenOrigin() + pos;
     } else {
         return pos;
     }
@@ -1003,6 +1959,7 @@ QPoint QMirClientWindow::mapToGlobal(const QPoint &pos) const
 
 void* QMirClientWindow::eglSurface() const
 {
+    QMutexLocker lock(&mMutex);
     return mSurface->eglSurface();
 }
 
@@ -1016,22 +1973,58 @@ WId QMirClientWindow::winId() const
     return mId;
 }
 
-void QMirClientWindow::onSwapBuffersDone()
+void QMirClientWindow::onSwapBuffersDone(qint64 swapDurationNs)
 {
-    QMutexLocker lock(&mMutex);
-    mSurface->onSwapBuffersDone();
+    mFrameStats.recordFrame(swapDurationNs);
+    mFrameScheduler.frameSwapped();
+    if (mReportSwapTiming.load()) {
+        const qint64 now = monotonicTimeNs();
+        bool notify;
+        {
+            QMutexLocker lock(&mMutex);
+            mTimedFrame = mFrameStats.frameCount();
+            mSubmitTimeNs = now - swapDurationNs;
+            mSwapDoneTimeNs = now;
+            notify = !mSwapTimingNotifyPending;
+            mSwapTimingNotifyPending = true;
+        }
+        if (notify) {
+            QMetaObject::invokeMethod(this, "notifySwapTiming", Qt::QueuedConnection);
+        }
+    }
+    if (adaptiveRenderScaleMinimum() > 0 && mRenderScaleAdaptive.load()) {
+        updateAdaptiveRenderScale();
+    }
 
-    if (mSurface->mNeedsExposeCatchup) {
-        mSurface->mNeedsExposeCatchup = false;
-        mWindowExposed = false;
+    const bool needsResizeRepaint = mSurface->onSwapBuffersDone();
+    if (needsResizeRepaint) {
+        mFrameStats.recordResizeRepaint();
+    }
 
-        lock.unlock();
-        QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+    bool needsExpose = needsResizeRepaint;
+    {
+        QMutexLocker lock(&mMutex);
+        if (mSurface->mNeedsExposeCatchup) {
+            mSurface->mNeedsExposeCatchup = false;
+            mWindowExposed = false;
+            needsExpose = true;
+        }
+    }
+
+    if (needsExpose) {
+        QMetaObject::invokeMethod(this, "scheduleExpose", Qt::QueuedConnection);
     }
 }
 
-void QMirClientWindow::handleScreenPropertiesChange(MirFormFactor formFactor, float scale)
+void QMirClientWindow::handleScreenPropertiesChange(MirFormFactor formFactor, float scale, qreal refreshRate)
 {
+    invalidateScreenOrigin();
+    mFrameStats.setRefreshRate(refreshRate);
+    mFrameScheduler.setRefreshRate(refreshRate);
+    if (mBufferingMode == BufferingMode::LowLatency) {
+        updateThrottling(); // capped at the refresh rate
+    }
+
     // Update the scale & form factor native-interface properties for the windows affected
     // as there is no convenient way to emit signals for those custom properties on a QScreen
     if (formFactor != mFormFactor) {
@@ -1050,19 +2043,419 @@ void QMirClientWindow::handleScreenPropertiesChange(MirFormFactor formFactor, fl
 
 void QMirClientWindow::updateSurfaceState()
 {
-    QMutexLocker lock(&mMutex);
     MirWindowState newState = mWindowVisible ? qtWindowStateToMirWindowState(mWindowState) :
                                                 mir_window_state_hidden;
     qCDebug(mirclient, "updateSurfaceState (window=%p, surfaceState=%s)", window(), mirWindowStateToStr(newState));
     if (newState != mSurface->state()) {
         mSurface->setState(newState);
-
-        lock.unlock();
         updatePanelHeightHack(newState != mir_window_state_fullscreen);
     }
 }
 
-QString QMirClientWindow::persistentSurfaceId()
+QString QMirClientWindow::persistentSurfaceId() const
 {
     return mSurface->persistentSurfaceId();
 }
+
+void QMirClientWindow::onPersistentSurfaceIdReady()
+{
+    qCDebug(mirclient, "onPersistentSurfaceIdReady(window=%p, id=%s)", window(), qPrintable(persistentSurfaceId()));
+    Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("persistentSurfaceId"));
+}
+
+void QMirClientWindow::applyPendingSpec()
+{
+    mSurface->applyPendingSpec();
+}
+
+int QMirClientWindow::swapInterval() const
+{
+    QMutexLocker lock(&mMutex);
+    return mReportedSwapInterval >= 0 ? mReportedSwapInterval : mSurface->format().swapInterval();
+}
+
+void QMirClientWindow::setSwapInterval(int interval)
+{
+    qCDebug(mirclient, "setSwapInterval(window=%p, interval=%d)", window(), interval);
+    mRequestedSwapInterval = interval;
+    if (mBufferingMode != BufferingMode::Default) {
+        return; // applied when back in the default mode
+    }
+    mSurface->setSwapInterval(interval);
+
+    // Applied by the rendering thread on its next makeCurrent, make sure there is one
+    window()->requestUpdate();
+}
+
+void QMirClientWindow::handleSwapIntervalChanged(int interval)
+{
+    qCDebug(mirclient, "handleSwapIntervalChanged(window=%p, interval=%d)", window(), interval);
+    {
+        QMutexLocker lock(&mMutex);
+        if (interval == mReportedSwapInterval) {
+            return;
+        }
+        mReportedSwapInterval = interval;
+    }
+    Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("swapInterval"));
+}
+
+void QMirClientWindow::syncSwapInterval()
+{
+    mSurface->syncSwapInterval();
+}
+
+void QMirClientWindow::aboutToMakeCurrent()
+{
+    mSurface->aboutToMakeCurrent();
+}
+
+void QMirClientWindow::doneCurrent()
+{
+    mSurface->doneCurrent();
+}
+
+qreal QMirClientWindow::targetFrameRate() const
+{
+    QMutexLocker lock(&mMutex);
+    return mTargetFrameRate;
+}
+
+void QMirClientWindow::setTargetFrameRate(qreal frameRate)
+{
+    qCDebug(mirclient, "setTargetFrameRate(window=%p, fps=%.1f)", window(), frameRate);
+    {
+        QMutexLocker lock(&mMutex);
+        if (qFuzzyCompare(frameRate, mTargetFrameRate)) {
+            return;
+        }
+        mTargetFrameRate = frameRate;
+    }
+    updateThrottling();
+    Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("targetFrameRate"));
+}
+
+QString QMirClientWindow::bufferingMode() const
+{
+    switch (mBufferingMode) {
+    case BufferingMode::LowLatency:
+        return QStringLiteral("low-latency");
+    case BufferingMode::Default:
+        return QStringLiteral("default");
+    }
+    Q_UNREACHABLE();
+}
+
+bool QMirClientWindow::setBufferingMode(const QString &mode)
+{
+    BufferingMode bufferingMode;
+    if (mode == QStringLiteral("low-latency")) {
+        bufferingMode = BufferingMode::LowLatency;
+    } else if (mode == QStringLiteral("default")) {
+        bufferingMode = BufferingMode::Default;
+    } else {
+        return false;
+    }
+
+    qCDebug(mirclient, "setBufferingMode(window=%p, mode=%s)", window(), qPrintable(mode));
+    if (bufferingMode != mBufferingMode) {
+        mBufferingMode = bufferingMode;
+        applyBufferingMode();
+        // The swap interval is applied by the rendering thread on its next makeCurrent. A new
+        // window needs no such nudge, it has yet to render at all.
+        window()->requestUpdate();
+        Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("bufferingMode"));
+    }
+    return true;
+}
+
+/*
+    Mir gives clients no control over the number of buffers in a stream, the swap interval is what
+    decides how deep the queue gets. With a swap interval of 0 the server drops all but the newest
+    frame and the client never waits for a buffer; the frame rate is capped at the refresh rate (60Hz
+    while the output hasn't told it) so that frames aren't rendered in vain. The cap is in place
+    before the interval drops to 0, a rendering thread of its own otherwise gets to spin unthrottled
+    in between. The default mode puts back the "swapInterval" set on the
+    window, or else the one of the requested format or QT_QPA_EGLFS_SWAPINTERVAL; a "swapInterval"
+    set while in low-latency mode waits for that.
+ */
+void QMirClientWindow::applyBufferingMode()
+{
+    updateThrottling();
+    switch (mBufferingMode) {
+    case BufferingMode::LowLatency:
+        mSurface->setSwapInterval(0);
+        break;
+    case BufferingMode::Default:
+        // Not -1, the surface has to be moved off the low-latency interval
+        mSurface->setSwapInterval(mRequestedSwapInterval >= 0
+                                  ? mRequestedSwapInterval : defaultSwapInterval(window()->requestedFormat()));
+        break;
+    }
+    mFrameStats.setBufferingMode(bufferingMode());
+}
+
+void QMirClientWindow::setReportSwapTiming(bool report)
+{
+    qCDebug(mirclient, "setReportSwapTiming(window=%p, report=%d)", window(), report);
+    mReportSwapTiming.store(report);
+}
+
+/*
+    When the last frame was submitted and when eglSwapBuffers returned, in nanoseconds of
+    CLOCK_MONOTONIC (the clock Mir input event timestamps use). Mir doesn't tell clients rendering
+    through EGL when their frames are presented, so neither is a presentation time.
+ */
+QVariantMap QMirClientWindow::swapTiming() const
+{
+    QMutexLocker lock(&mMutex);
+    QVariantMap timing;
+    timing.insert(QStringLiteral("frame"), mTimedFrame);
+    timing.insert(QStringLiteral("submitTimeNs"), mSubmitTimeNs);
+    timing.insert(QStringLiteral("swapDoneTimeNs"), mSwapDoneTimeNs);
+    return timing;
+}
+
+// Listeners get one notification per GUI thread event loop iteration at most, rather than one
+// from the rendering thread per frame
+void QMirClientWindow::notifySwapTiming()
+{
+    {
+        QMutexLocker lock(&mMutex);
+        mSwapTimingNotifyPending = false;
+    }
+    Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("swapTiming"));
+}
+
+qreal QMirClientWindow::renderScale() const
+{
+    return mSurface->renderScale();
+}
+
+// The render scale only sizes the buffers, Qt doesn't support ratios below 1
+qreal QMirClientWindow::devicePixelRatio() const
+{
+    return screen()->devicePixelRatio();
+}
+
+void QMirClientWindow::setRenderScale(qreal scale)
+{
+    qCDebug(mirclient, "setRenderScale(window=%p, scale=%.2f)", window(), scale);
+    mRequestedRenderScale = scale;
+    mRenderScaleAdaptive.store(true);
+    applyRenderScale(scale);
+}
+
+void QMirClientWindow::applyRenderScale(qreal scale)
+{
+    if (qFuzzyCompare(scale, renderScale())) {
+        return;
+    }
+
+    mSurface->setRenderScale(scale);
+
+    // The buffers change size, have everything rendered again
+    mFrameScheduler.scheduleExpose();
+    Q_EMIT mNativeInterface->windowPropertyChanged(this, QStringLiteral("renderScale"));
+}
+
+/*
+    Adaptive render scale, opt-in with QTUBUNTU_ADAPTIVE_RENDER_SCALE: every so many frames, a window
+    that missed more than a tenth of its vblanks lowers its render scale a notch, down to the
+    configured minimum, and one that missed none for several periods in a row raises it again, up
+    to the scale it asked for. Only raster windows and windows that set "renderScale" themselves
+    take part, any other sets its viewport from its size and would render cropped. Windows with a
+    frame rate cap are left alone as the cap makes their frames look late.
+ */
+void QMirClientWindow::updateAdaptiveRenderScale()
+{
+    const quint64 periodFrames = 60;
+    const int smoothPeriodsBeforeRaise = 5;
+
+    const quint64 frames = mFrameStats.frameCount();
+    if (frames - mAdaptiveFrameMark < periodFrames) {
+        return;
+    }
+
+    const quint64 late = mFrameStats.lateFrameCount();
+    const qreal lateRatio = qreal(late - mAdaptiveLateMark) / (frames - mAdaptiveFrameMark);
+    mAdaptiveFrameMark = frames;
+    mAdaptiveLateMark = late;
+
+    int direction = 0;
+    if (mFrameIntervalUs.load() > 0 || lateRatio > 0) {
+        mSmoothPeriods = 0;
+        if (mFrameIntervalUs.load() == 0 && lateRatio > 0.1) {
+            direction = -1;
+        }
+    } else if (++mSmoothPeriods >= smoothPeriodsBeforeRaise) {
+        mSmoothPeriods = 0;
+        direction = 1;
+    }
+
+    if (direction != 0) {
+        qCDebug(mirclientFrameStats, "window=%p %.0f%% late frames, %s render scale",
+                window(), lateRatio * 100, direction < 0 ? "lowering" : "raising");
+        QMetaObject::invokeMethod(this, "stepRenderScale", Qt::QueuedConnection, Q_ARG(int, direction));
+    }
+}
+
+void QMirClientWindow::stepRenderScale(int direction)
+{
+    const qreal step = 0.1;
+    const qreal current = renderScale();
+    const qreal scale = direction < 0
+            ? qMin(current, qMax<qreal>(adaptiveRenderScaleMinimum(), current - step))
+            : qMax(current, qMin(mRequestedRenderScale, current + step));
+    applyRenderScale(scale);
+}
+
+/*
+    Combines the frame rate asked for through "targetFrameRate" with the reduced rates configured
+    for unfocused (QTUBUNTU_UNFOCUSED_FRAME_RATE) and occluded (QTUBUNTU_OCCLUDED_FRAME_RATE)
+    windows and the refresh rate for low-latency buffering, the lowest one wins. Popups and tooltips
+    never get focus, so only plain windows and dialogs are throttled for lack of it. Windows
+    rendering on the GUI thread are capped by QMirClientFrameScheduler spacing out their exposes
+    and update requests. A rendering thread of its own, like the threaded Qt Quick render loop and
+    its animators, swaps without asking the GUI thread: swapBuffers() holds its frames back instead.
+ */
+void QMirClientWindow::updateThrottling()
+{
+    const auto type = window()->type() & Qt::WindowType_Mask;
+    const bool focusable = type == Qt::Window || type == Qt::Dialog;
+    const bool unfocused = focusable && !mWindowFocused;
+
+    QMutexLocker lock(&mMutex);
+    qreal frameRate = mTargetFrameRate;
+    auto limitTo = [&frameRate](qreal limit) {
+        if (limit > 0 && (frameRate <= 0 || limit < frameRate)) {
+            frameRate = limit;
+        }
+    };
+    if (unfocused) {
+        limitTo(unfocusedFrameRate());
+    }
+    if (mWindowOccluded) {
+        limitTo(occludedFrameRate());
+    }
+    if (mBufferingMode == BufferingMode::LowLatency) {
+        const qreal refreshRate = window()->screen()->refreshRate();
+        limitTo(refreshRate > 0 ? refreshRate : 60);
+    }
+    mFrameIntervalUs.store(frameRate > 0 ? qRound(1000000 / frameRate) : 0);
+    mFrameScheduler.setFrameInterval(mFrameIntervalUs.load());
+
+    const bool paused = unfocused && qFuzzyIsNull(unfocusedFrameRate());
+    if (paused == mThrottlePaused) {
+        return;
+    }
+    mThrottlePaused = paused;
+
+    qCDebug(mirclient, "updateThrottling(window=%p) - rendering %s", window(), paused ? "paused" : "resumed");
+    lock.unlock();
+    mFrameScheduler.setPaused(paused);
+    QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+}
+
+void QMirClientWindow::waitForFrameSlot()
+{
+    // The backing store and the non-threaded render loop swap on the GUI thread, which must never
+    // block: there the cap is applied to the exposes and update requests QMirClientFrameScheduler
+    // sends instead
+    if (QThread::currentThread() == thread()) {
+        return;
+    }
+
+    const int intervalUs = mFrameIntervalUs.load();
+    if (intervalUs <= 0) {
+        mNextFrameSlotUs = 0;
+        return;
+    }
+
+    if (!mFrameSlotClock.isValid()) {
+        mFrameSlotClock.start();
+    }
+
+    const qint64 now = mFrameSlotClock.nsecsElapsed() / 1000;
+    if (mNextFrameSlotUs > now) {
+        QThread::usleep(mNextFrameSlotUs - now);
+    }
+
+    // A frame that is late gets a full interval from now, missed slots are not made up for
+    mNextFrameSlotUs = qMax(now, mNextFrameSlotUs) + intervalUs;
+}
+
+int QMirClientWindow::bufferAge() const
+{
+    return mSurface->bufferAge();
+}
+
+void QMirClientWindow::addSwapDamage(const QRegion &region)
+{
+    QMutexLocker lock(&mMutex);
+    mSwapDamage |= region;
+}
+
+QRegion QMirClientWindow::takeSwapDamage()
+{
+    QMutexLocker lock(&mMutex);
+    QRegion damage;
+    std::swap(damage, mSwapDamage);
+    return damage;
+}
+
+/*
+    Opt-in with QTUBUNTU_RELEASE_HIDDEN_BUFFERS_TIMEOUT: windows that stay hidden or minimized
+    for that long give their buffers back, and get them again before they are next exposed.
+ */
+void QMirClientWindow::updateBufferRelease()
+{
+    const int timeout = releaseHiddenBuffersTimeout();
+    if (timeout < 0) {
+        return;
+    }
+
+    const bool hidden = !mWindowVisible || mWindowState == Qt::WindowMinimized;
+    if (hidden) {
+        if (!mReleaseBuffersTimer.isActive()) {
+            mReleaseBuffersTimer.start(timeout);
+        }
+    } else {
+        mReleaseBuffersTimer.stop();
+        if (mSurface->restoreBuffers()) {
+            // isExposed() changed, and the new buffers have nothing in them yet
+            QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+        }
+    }
+}
+
+void QMirClientWindow::releaseHiddenBuffers()
+{
+    if ((!mWindowVisible || mWindowState == Qt::WindowMinimized) && mSurface->releaseBuffers()) {
+        QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+    }
+}
+
+void QMirClientWindow::waitForMirWindow()
+{
+    mSurface->waitForCreation();
+    onMirWindowCreated();
+}
+
+void QMirClientWindow::onMirWindowCreated()
+{
+    if (!mSurface->completeCreation()) {
+        return;
+    }
+
+    qCDebug(mirclient, "onMirWindowCreated(window=%p)", window());
+    {
+        QMutexLocker lock(&mMutex);
+        mWindowExposed = mSurface->mNeedsExposeCatchup == false;
+    }
+
+    updatePanelHeightHack(mSurface->state() != mir_window_state_fullscreen);
+
+    // This is the first expose the window gets, everything before was held back as it had nothing to render to
+    QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(), geometry().size()));
+}
@@ -42,8 +42,16 @@
 #define QMIRCLIENTWINDOW_H
 
 #include <qpa/qplatformwindow.h>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QSharedPointer>
 #include <QMutex>
+#include <QRegion>
+#include <QTimer>
+
+#include "qmirclientframescheduler.h"
+#include "qmirclientframestats.h"
+#include "qmirclientsurfacepool.h"
 
 #include <mir_toolkit/common.h> // needed only for MirFormFactor enum
 #include <mir_toolkit/mir_window.h>
@@ -54,9 +62,11 @@
 
 class QMirClientAppStateController;
 class QMirClientDebugExtension;
+class QMirClientEglConfigCache;
 class QMirClientNativeInterface;
 class QMirClientInput;
 class QMirClientScreen;
+class QMirClientWindowRegistry;
 class UbuntuSurface;
 struct MirConnection;
 
@@ -83,26 +93,95 @@ public:
 
     QPoint mapToGlobal(const QPoint &pos) const override;
     QSurfaceFormat format() const override;
+    qreal devicePixelRatio() const override;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    void requestUpdate() override;
+#endif
 
     // Additional Window properties exposed by NativeInterface
     MirFormFactor formFactor() const { return mFormFactor; }
     float scale() const { return mScale; }
+    QVariantMap frameStats() const { return mFrameStats.toVariantMap(); }
+    int swapInterval() const;
+    void setSwapInterval(int interval);
+    qreal targetFrameRate() const;
+    void setTargetFrameRate(qreal frameRate);
+    qreal renderScale() const;
+    void setRenderScale(qreal scale);
+    // How deep a queue of frames the window renders ahead, see applyBufferingMode()
+    enum class BufferingMode { LowLatency, Default };
+    QString bufferingMode() const;
+    bool setBufferingMode(const QString &mode);
+    bool reportsSwapTiming() const { return mReportSwapTiming.load(); }
+    void setReportSwapTiming(bool report);
+    QVariantMap swapTiming() const;
 
     // New methods.
     void *eglSurface() const;
     MirWindow *mirWindow() const;
+    QSize takePendingResize();
     void handleSurfaceResized(int width, int height);
     void handleSurfaceExposeChange(bool exposed);
     void handleSurfaceFocusChanged(bool focused);
     void handleSurfaceVisibilityChanged(bool visible);
     void handleSurfaceStateChanged(Qt::WindowState state);
-    void onSwapBuffersDone();
-    void handleScreenPropertiesChange(MirFormFactor formFactor, float scale);
-    QString persistentSurfaceId();
+    void onSwapBuffersDone(qint64 swapDurationNs);
+    void handleScreenPropertiesChange(MirFormFactor formFactor, float scale, qreal refreshRate);
+    void handleSwapIntervalChanged(int interval);
+    void waitForMirWindow();
+    void updatePlatformGeometry(const QRect &geometry);
+    void handleSurfacePlacementChanged();
+
+    // Requested asynchronously at creation: persistentSurfaceId() is empty until Mir answers,
+    // which is signalled through QMirClientNativeInterface::windowPropertyChanged.
+    QString persistentSurfaceId() const;
+
+    // Creates a hidden main window of the given size, see QMirClientSpeculativeWindow
+    static QMirClientSurfacePool::Surface createSpeculativeSurface(MirConnection *connection, EGLDisplay display,
+                                                                   QMirClientEglConfigCache *configCache,
+                                                                   const QSize &size, QMirClientSurfacePool::Key *key);
+
+    // Called by QMirClientOpenGLContext on the rendering thread
+    void aboutToMakeCurrent();
+    void doneCurrent(); // once the window's surface is no longer current
+    void syncSwapInterval();
+    void waitForFrameSlot();
+
+    // Swaps since the current back buffer was last used (EGL_EXT_buffer_age), 0 if unknown.
+    // Only meaningful with the window's surface current on the calling thread.
+    int bufferAge() const;
+
+    // What changed since the last frame, for the compositor to only recompose that. Damage adds
+    // up until the next swap, which takes it; no damage means the whole window changed.
+    void addSwapDamage(const QRegion &region);
+    QRegion takeSwapDamage();
+
+private Q_SLOTS:
+    void applyPendingSpec();
+    void onMirWindowCreated();
+    void onPersistentSurfaceIdReady();
+    void releaseHiddenBuffers();
+    void stepRenderScale(int direction);
+    void scheduleExpose();
+    void notifySwapTiming();
 
 private:
+    friend class UbuntuSurface; // sets the EGL surface under mMutex, reads and feeds the frame stats
+
     void updatePanelHeightHack(bool enable);
     void updateSurfaceState();
+    void updateThrottling();
+    void deliverExpose();
+    void deliverUpdateRequest();
+    void updateBufferRelease();
+    void updateAdaptiveRenderScale();
+    void applyBufferingMode();
+    void applyRenderScale(qreal scale);
+    QPoint screenOrigin() const;
+    void invalidateScreenOrigin();
+
+    // Only guards state shared with the rendering thread (platform geometry, exposure, the EGL
+    // surface and the swap interval/frame rate properties). Never held across a call into Mir or EGL.
     mutable QMutex mMutex;
     const WId mId;
     Qt::WindowState mWindowState;
@@ -112,9 +191,55 @@ private:
     QMirClientAppStateController *mAppStateController;
     QMirClientDebugExtension *mDebugExtention;
     QMirClientNativeInterface *mNativeInterface;
+    QMirClientWindowRegistry * const mRegistry;
     std::unique_ptr<UbuntuSurface> mSurface;
     float mScale;
     MirFormFactor mFormFactor;
+    QMirClientFrameStats mFrameStats;
+    QMirClientFrameScheduler mFrameScheduler;
+
+    QTimer mReleaseBuffersTimer;
+
+    // Where the debug extension last said the window is, see screenOrigin()
+    mutable QPoint mScreenOrigin;
+    mutable bool mScreenOriginValid{false};
+    int mScreenOriginGeneration{0};
+    mutable int mScreenOriginTranslations{0}; // logged under qt.qpa.mirclient.debug
+
+    QRegion mSwapDamage; // guarded by mMutex
+
+    // Timing of the last frame when reporting it, guarded by mMutex
+    QAtomicInt mReportSwapTiming{0};
+    quint64 mTimedFrame{0};
+    qint64 mSubmitTimeNs{0};
+    qint64 mSwapDoneTimeNs{0};
+    bool mSwapTimingNotifyPending{false};
+
+    int mReportedSwapInterval{-1};
+    int mRequestedSwapInterval{-1}; // "swapInterval" as last set, GUI thread only
+    qreal mTargetFrameRate{0};
+
+    BufferingMode mBufferingMode{BufferingMode::Default}; // GUI thread only
+
+    // Inputs of the throttling policy, GUI thread only
+    bool mWindowFocused{true};
+    bool mWindowOccluded{false};
+    bool mThrottlePaused{false}; // guarded by mMutex, isExposed() reads it
+
+    // Frame rate cap, the slot is only used by a rendering thread other than the GUI thread
+    QAtomicInt mFrameIntervalUs{0};
+    QElapsedTimer mFrameSlotClock;
+    qint64 mNextFrameSlotUs{0};
+
+    // Render scale asked for through "renderScale", the adaptive mode never goes above it
+    qreal mRequestedRenderScale{1};
+    // Whether the adaptive mode may change the render scale, read on the rendering thread
+    QAtomicInt mRenderScaleAdaptive{0};
+
+    // Frame stats at the end of the last adaptive render scale period, rendering thread only
+    quint64 mAdaptiveFrameMark{0};
+    quint64 mAdaptiveLateMark{0};
+    int mSmoothPeriods{0};
 };
 
 #endif // QMIRCLIENTWINDOW_H
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 Canonical, Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QMIRCLIENTWINDOWREGISTRY_H
+#define QMIRCLIENTWINDOWREGISTRY_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QtGui/qwindowdefs.h>
+
+class QMirClientWindow;
+
+/*
+ * Live platform windows by WId.
+ *
+ * Lookups only take a read lock and may happen on any thread, but windows are created and
+ * destroyed on the GUI thread: a pointer obtained elsewhere must not be dereferenced unless
+ * the window is known to outlive its use.
+ */
+class QMirClientWindowRegistry
+{
+public:
+    // Thread-safe, ids are never reused
+    static WId makeId();
+
+    void addWindow(QMirClientWindow *window, WId id);
+    void removeWindow(WId id);
+
+    QMirClientWindow *windowForId(WId id) const;
+
+private:
+    static QAtomicInteger<quintptr> sNextId;
+
+    mutable QReadWriteLock mLock;
+    QHash<WId, QMirClientWindow *> mById;
+};
+
+#endif // QMIRCLIENTWINDOWREGISTRY_H
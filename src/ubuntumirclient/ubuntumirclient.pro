@@ -20,6 +20,9 @@ SOURCES = \
     qmirclientcursor.cpp \
     qmirclientdebugextension.cpp \
     qmirclientdesktopwindow.cpp \
+    qmirclienteglconfigcache.cpp \
+    qmirclientframescheduler.cpp \
+    qmirclientframestats.cpp \
     qmirclientglcontext.cpp \
     qmirclientinput.cpp \
     qmirclientintegration.cpp \
@@ -28,7 +31,11 @@ SOURCES = \
     qmirclientplugin.cpp \
     qmirclientscreen.cpp \
     qmirclientscreenobserver.cpp \
+    qmirclientspeculativewindow.cpp \
+    qmirclientsurfacepool.cpp \
+    qmirclientsurfacereaper.cpp \
     qmirclientwindow.cpp \
+    qmirclientwindowregistry.cpp \
     qmirclientappstatecontroller.cpp
 
 HEADERS = \
@@ -37,6 +44,9 @@ HEADERS = \
     qmirclientcursor.h \
     qmirclientdebugextension.h \
     qmirclientdesktopwindow.h \
+    qmirclienteglconfigcache.h \
+    qmirclientframescheduler.h \
+    qmirclientframestats.h \
     qmirclientglcontext.h \
     qmirclientinput.h \
     qmirclientintegration.h \
@@ -46,7 +56,11 @@ HEADERS = \
     qmirclientplugin.h \
     qmirclientscreenobserver.h \
     qmirclientscreen.h \
+    qmirclientspeculativewindow.h \
+    qmirclientsurfacepool.h \
+    qmirclientsurfacereaper.h \
     qmirclientwindow.h \
+    qmirclientwindowregistry.h \
     qmirclientlogging.h \
     qmirclientappstatecontroller.h \
     ../shared/ubuntutheme.h